@@ -4,15 +4,19 @@ if exist "shaders" goto :run
 echo "shader folder is missing"
 echo error: 1
 
-echo error: %errorlevel%
-
-pause
-goto :end
+if not "%1"=="--no-pause" pause
+exit /b 1
 
 :run
+set "SDK_BIN=C://VulkanSDK//1.3.224.1//Bin"
+if defined VULKAN_SDK set "SDK_BIN=%VULKAN_SDK%//Bin"
+
 if exist "shaders/compiled" rmdir /s /q "shaders/compiled"
 mkdir "shaders/compiled"
 
-dotnet-script pre_compile_shaders.csx "shaders" "shaders//compiled" "C://VulkanSDK//1.3.224.1//Bin//glslc.exe"
-pause
-:end
\ No newline at end of file
+dotnet-script pre_compile_shaders.csx "shaders" "shaders//compiled" "%SDK_BIN%//glslc.exe" "%SDK_BIN%//spirv-val.exe"
+set RESULT=%errorlevel%
+if not %RESULT%==0 echo error: %RESULT%
+
+if not "%1"=="--no-pause" pause
+exit /b %RESULT%
@@ -1,15 +1,35 @@
 #version 450
+// variant: nonuniform NONUNIFORM_INDEXING
+
+#ifdef NONUNIFORM_INDEXING
+#extension GL_EXT_nonuniform_qualifier : require
+#define MATERIAL_INDEX nonuniformEXT(fragMaterialIndex)
+#else
+#define MATERIAL_INDEX fragMaterialIndex
+#endif
 
 layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec2 fragTexCoord;
 layout (location = 2) in float fragTime;
+// Same for every instance of a draw but not across the draws of a multi-draw. Only the nonuniform variant may index
+// with it when draws of one multi-draw differ, otherwise SorpGpuCuller::draw splits the multi-draw where it changes.
+layout (location = 3) flat in uint fragMaterialIndex;
 
 layout (location = 0) out vec4 outColor;
 
-layout (binding = 1) uniform sampler2D texSampler;
+// Bindless texture table, the size is specialized to SorpBindlessTable::capacity()
+layout (constant_id = 0) const uint TEXTURE_CAPACITY = 16;
+layout (set = 1, binding = 0) uniform sampler2D textures[TEXTURE_CAPACITY];
+// False when the device can't index sampler arrays dynamically, every draw samples the default texture then
+layout (constant_id = 1) const bool DYNAMIC_INDEXING = true;
 
 void main()
 {
 	vec3 multColor = vec3(inColor.x * sin(fragTime * 0.5f + 0.3), inColor.y * cos(fragTime * 0.5f + 2), inColor.z + sin(fragTime * 0.5f + 4));
-	outColor = vec4(multColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+	vec3 texel;
+	if (DYNAMIC_INDEXING)
+		texel = texture(textures[MATERIAL_INDEX], fragTexCoord).rgb;
+	else
+		texel = texture(textures[0], fragTexCoord).rgb;
+	outColor = vec4(multColor * texel, 1.0);
 }
\ No newline at end of file
@@ -3,23 +3,31 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) in mat4 instanceModel;
+layout(location = 7) in vec4 instanceColor;
+layout(location = 8) in uint instanceMaterialIndex;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out float fragTime;
+layout(location = 3) flat out uint fragMaterialIndex;
 
 layout(binding = 0) uniform UniformBufferObject {
-	mat4 model;
 	mat4 view;
 	mat4 proj;
 	float time;
 	vec3 _padding;
 } ubo;
 
+layout(push_constant) uniform PushConstants {
+	mat4 model;
+} push;
+
 void main()
 {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-	fragColor = inColor;
+	gl_Position = ubo.proj * ubo.view * instanceModel * push.model * vec4(inPosition, 1.0);
+	fragColor = inColor * instanceColor.rgb;
 	fragTexCoord = texCoord;
 	fragTime = ubo.time;
+	fragMaterialIndex = instanceMaterialIndex;
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "SorpAssetManager.hpp"
+#include "SorpUploadQueue.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpAssetManager::SorpAssetManager(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem, SorpTextureLoader& textureLoader,
+		SorpBindlessTable& bindlessTable, SorpGeometryArena& geometryArena, VkSampler sampler, const SorpModel& placeholderMesh) :
+		_renderDevice{renderDevice}, _jobSystem{jobSystem}, _textureLoader{textureLoader}, _bindlessTable{bindlessTable},
+		_geometryArena{geometryArena}, _sampler{sampler}, _placeholderMesh{placeholderMesh}
+	{
+	}
+
+	SorpAssetManager::~SorpAssetManager()
+	{
+		// Jobs point into the loads
+		_jobSystem.wait(_jobs);
+
+		VkDevice device = _renderDevice.device();
+		for (size_t i = 0; i < _textureLoads.size(); i++)
+		{
+			TextureLoad& load = *_textureLoads[i];
+			if (load.state == LoadState::Published)
+			{
+				_bindlessTable.releaseTexture(_textureSlots[i]);
+				VkImageView view = load.view;
+				_renderDevice.deferDestroy([device, view]() { vkDestroyImageView(device, view, nullptr); });
+			}
+			_textureLoader.destroy(load.texture);
+		}
+		// Models free their arena ranges deferred on their own
+		_meshLoads.clear();
+	}
+
+	SorpAssetManager::TextureHandle SorpAssetManager::requestTexture(const std::string& path)
+	{
+		auto load = std::make_unique<TextureLoad>();
+		load->path = path;
+		TextureLoad* target = load.get();
+
+		TextureHandle handle = static_cast<TextureHandle>(_textureLoads.size());
+		_textureLoads.push_back(std::move(load));
+		_textureSlots.push_back(SorpBindlessTable::DEFAULT_TEXTURE_SLOT);
+		_pendingCount++;
+
+		// Decoding queues the upload itself, update() only flushes and publishes
+		_jobSystem.run([this, target]()
+		{
+			SorpTextureLoader::Texture texture{};
+			std::string error;
+			try
+			{
+				texture = _textureLoader.loadFile(target->path);
+			}
+			catch (const std::exception& e)
+			{
+				error = e.what();
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			target->texture = texture;
+			target->error = error;
+			target->state = error.empty() ? LoadState::Loaded : LoadState::Failed;
+		}, &_jobs);
+		return handle;
+	}
+
+	SorpAssetManager::MeshHandle SorpAssetManager::requestMesh(MeshSource source)
+	{
+		auto load = std::make_unique<MeshLoad>();
+		MeshLoad* target = load.get();
+
+		MeshHandle handle = static_cast<MeshHandle>(_meshLoads.size());
+		_meshLoads.push_back(std::move(load));
+		_meshes.push_back(&_placeholderMesh);
+		_pendingCount++;
+
+		// The arena is thread safe and the model's upload goes through the upload queue
+		_jobSystem.run([this, target, source]()
+		{
+			std::unique_ptr<SorpModel> model;
+			std::string error;
+			try
+			{
+				std::vector<SorpModel::Vertex> vertices;
+				std::vector<uint16_t> indexes;
+				source(vertices, indexes);
+				model = std::make_unique<SorpModel>(_geometryArena, vertices, indexes);
+			}
+			catch (const std::exception& e)
+			{
+				error = e.what();
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			target->model = std::move(model);
+			target->error = error;
+			target->state = error.empty() ? LoadState::Loaded : LoadState::Failed;
+		}, &_jobs);
+		return handle;
+	}
+
+	bool SorpAssetManager::update()
+	{
+		if (_pendingCount == 0)
+		{
+			return false;
+		}
+
+		SORP_PROFILE_SCOPE("publish assets");
+
+		std::vector<size_t> textures;
+		std::vector<size_t> meshes;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (size_t i = 0; i < _textureLoads.size(); i++)
+			{
+				// One broken file shouldn't take the app down, it keeps showing the default texture
+				if (_textureLoads[i]->state == LoadState::Failed)
+				{
+					std::cerr << "failed to stream texture " << _textureLoads[i]->path << ": " << _textureLoads[i]->error << std::endl;
+					_textureLoads[i]->state = LoadState::Abandoned;
+					_pendingCount--;
+				}
+				if (_textureLoads[i]->state == LoadState::Loaded)
+				{
+					textures.push_back(i);
+				}
+			}
+			for (size_t i = 0; i < _meshLoads.size(); i++)
+			{
+				if (_meshLoads[i]->state == LoadState::Failed)
+				{
+					std::cerr << "failed to stream mesh " << i << ": " << _meshLoads[i]->error << std::endl;
+					_meshLoads[i]->state = LoadState::Abandoned;
+					_pendingCount--;
+				}
+				if (_meshLoads[i]->state == LoadState::Loaded)
+				{
+					meshes.push_back(i);
+				}
+			}
+		}
+
+		if (textures.empty() && meshes.empty())
+		{
+			return false;
+		}
+
+		// Submitted ahead of the frame on the same queue, the upload barriers make the data visible to it
+		_renderDevice.uploadQueue().flush();
+
+		for (size_t i : textures)
+		{
+			TextureLoad& load = *_textureLoads[i];
+			load.view = createImageView(load.texture);
+
+			// New slot first, the old one stays valid for frames still in flight until the table retires it
+			uint32_t previousSlot = _textureSlots[i];
+			_textureSlots[i] = _bindlessTable.registerTexture(load.view, _sampler);
+			if (previousSlot != SorpBindlessTable::DEFAULT_TEXTURE_SLOT)
+			{
+				_bindlessTable.releaseTexture(previousSlot);
+			}
+			load.state = LoadState::Published;
+			_pendingCount--;
+		}
+
+		for (size_t i : meshes)
+		{
+			MeshLoad& load = *_meshLoads[i];
+			_meshes[i] = load.model.get();
+			load.state = LoadState::Published;
+			_pendingCount--;
+		}
+		return true;
+	}
+
+	VkImageView SorpAssetManager::createImageView(const SorpTextureLoader::Texture& texture)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = texture.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = texture.format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = texture.mipLevels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		VkImageView imageView;
+		if (vkCreateImageView(_renderDevice.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create streamed texture image view!");
+		}
+		return imageView;
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpJobSystem.hpp"
+#include "SorpTextureLoader.hpp"
+#include "SorpBindlessTable.hpp"
+#include "SorpModel.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	// Hands out texture and mesh handles right away and loads their data on the job system. Until an asset is
+	// resident its handle resolves to a placeholder: the default bindless texture or the placeholder mesh.
+	// Loaded assets only become visible in update(), so a frame never sees an asset change while it is recorded.
+	class SorpAssetManager
+	{
+	public:
+		using TextureHandle = uint32_t;
+		using MeshHandle = uint32_t;
+		// Runs on a worker thread
+		using MeshSource = std::function<void(std::vector<SorpModel::Vertex>& vertices, std::vector<uint16_t>& indexes)>;
+
+		SorpAssetManager(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem, SorpTextureLoader& textureLoader,
+			SorpBindlessTable& bindlessTable, SorpGeometryArena& geometryArena, VkSampler sampler, const SorpModel& placeholderMesh);
+		// Waits for loads still running
+		~SorpAssetManager();
+
+		SorpAssetManager(const SorpAssetManager&) = delete;
+		SorpAssetManager& operator=(const SorpAssetManager&) = delete;
+
+		TextureHandle requestTexture(const std::string& path);
+		MeshHandle requestMesh(MeshSource source);
+
+		// Call on the main thread at the start of a frame, before anything is recorded. Flushes the uploads of
+		// finished loads and publishes them, returns true when any handle now resolves differently. Failed loads are
+		// logged and their handles stay on the placeholder.
+		bool update();
+
+		// Safe to call while recording on any thread, only update() changes what they return
+		uint32_t textureSlot(TextureHandle handle) const { return _textureSlots[handle]; }
+		const SorpModel& mesh(MeshHandle handle) const { return *_meshes[handle]; }
+
+		bool isResident(TextureHandle handle) const { return _textureSlots[handle] != SorpBindlessTable::DEFAULT_TEXTURE_SLOT; }
+		// Requests that are neither resident nor failed
+		uint32_t pendingCount() const { return _pendingCount; }
+
+	private:
+		enum class LoadState
+		{
+			Loading,
+			Loaded,
+			Failed,
+			Published,
+			// Failed and reported, the handle keeps resolving to the placeholder
+			Abandoned
+		};
+
+		// Written by the loading job, read by update() once the state left Loading
+		struct TextureLoad
+		{
+			std::string path;
+			LoadState state = LoadState::Loading;
+			SorpTextureLoader::Texture texture;
+			VkImageView view = VK_NULL_HANDLE;
+			std::string error;
+		};
+
+		struct MeshLoad
+		{
+			LoadState state = LoadState::Loading;
+			std::unique_ptr<SorpModel> model;
+			std::string error;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		SorpJobSystem& _jobSystem;
+		SorpTextureLoader& _textureLoader;
+		SorpBindlessTable& _bindlessTable;
+		SorpGeometryArena& _geometryArena;
+		VkSampler _sampler;
+		const SorpModel& _placeholderMesh;
+
+		std::mutex _mutex;
+		SorpJobCounter _jobs;
+		std::vector<std::unique_ptr<TextureLoad>> _textureLoads;
+		std::vector<std::unique_ptr<MeshLoad>> _meshLoads;
+		uint32_t _pendingCount = 0;
+
+		// What handles resolve to, only update() writes them
+		std::vector<uint32_t> _textureSlots;
+		std::vector<const SorpModel*> _meshes;
+
+		VkImageView createImageView(const SorpTextureLoader::Texture& texture);
+	};
+}
@@ -0,0 +1,254 @@
+#include "SorpBenchmark.hpp"
+
+#include "SorpJobSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	namespace
+	{
+		constexpr uint32_t OVERHEAD_JOB_COUNT = 200000;
+		constexpr uint32_t SCALING_ELEMENT_COUNT = 1 << 22;
+		constexpr uint32_t SCALING_GRAIN_SIZE = 4096;
+		constexpr int REPETITIONS = 5;
+
+		using Clock = std::chrono::high_resolution_clock;
+
+		double elapsedMs(Clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
+
+		// Best of a few runs to keep OS noise out of the numbers
+		template<typename Function>
+		double bestOf(Function&& function)
+		{
+			double best = 0.0;
+			for (int i = 0; i < REPETITIONS; i++)
+			{
+				auto start = Clock::now();
+				function();
+				double ms = elapsedMs(start);
+				best = (i == 0 || ms < best) ? ms : best;
+			}
+			return best;
+		}
+
+		// Driver supplied strings like the device name may contain quotes or backslashes
+		void writeString(std::ostream& out, const std::string& value)
+		{
+			out << '"';
+			for (char c : value)
+			{
+				if (c == '"' || c == '\\')
+				{
+					out << '\\' << c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20)
+				{
+					out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+						<< std::dec << std::setfill(' ');
+				}
+				else
+				{
+					out << c;
+				}
+			}
+			out << '"';
+		}
+
+		void writeTimings(std::ostream& out, std::vector<double> samples)
+		{
+			std::sort(samples.begin(), samples.end());
+			auto percentile = [&](double p)
+			{
+				size_t index = static_cast<size_t>(std::ceil(p * samples.size()));
+				return samples[std::min(std::max(index, size_t{ 1 }) - 1, samples.size() - 1)];
+			};
+			double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+
+			out << "{ \"mean\": " << mean << ", \"p50\": " << percentile(0.50) << ", \"p90\": " << percentile(0.90)
+				<< ", \"p99\": " << percentile(0.99) << ", \"max\": " << samples.back() << " }";
+		}
+	}
+
+	void SorpBenchmark::runJobSystem(std::ostream& out)
+	{
+		uint32_t maxThreads = SorpJobSystem::defaultWorkerCount() + 1;
+		std::vector<uint32_t> threadCounts;
+		for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(maxThreads);
+
+		out << std::fixed << std::setprecision(1);
+		out << "job system overhead (" << OVERHEAD_JOB_COUNT << " empty jobs)\n";
+		out << "threads  external ns/job  worker ns/job\n";
+		for (uint32_t threads : threadCounts)
+		{
+			SorpJobSystem jobSystem{ threads - 1 };
+
+			// Submitted from this thread through the injection queue
+			double externalMs = bestOf([&]
+			{
+				SorpJobCounter counter;
+				for (uint32_t i = 0; i < OVERHEAD_JOB_COUNT; i++)
+				{
+					jobSystem.run([] {}, &counter);
+				}
+				jobSystem.wait(counter);
+			});
+
+			// Submitted from a job, so they land in a worker deque and get stolen from there
+			double workerMs = bestOf([&]
+			{
+				SorpJobCounter counter;
+				jobSystem.run([&]
+				{
+					for (uint32_t i = 0; i < OVERHEAD_JOB_COUNT; i++)
+					{
+						jobSystem.run([] {}, &counter);
+					}
+				}, &counter);
+				jobSystem.wait(counter);
+			});
+
+			out << std::setw(7) << threads
+				<< std::setw(17) << externalMs * 1e6 / OVERHEAD_JOB_COUNT
+				<< std::setw(15) << workerMs * 1e6 / OVERHEAD_JOB_COUNT << '\n';
+		}
+
+		std::vector<float> values(SCALING_ELEMENT_COUNT);
+		out << "\nparallelFor scaling (" << SCALING_ELEMENT_COUNT << " elements, grain " << SCALING_GRAIN_SIZE << ")\n";
+		out << "threads       ms  speedup\n";
+		double singleThreadMs = 0.0;
+		for (uint32_t threads : threadCounts)
+		{
+			SorpJobSystem jobSystem{ threads - 1 };
+
+			double ms = bestOf([&]
+			{
+				jobSystem.parallelFor(SCALING_ELEMENT_COUNT, SCALING_GRAIN_SIZE, [&](uint32_t first, uint32_t count)
+				{
+					for (uint32_t i = first; i < first + count; i++)
+					{
+						float x = static_cast<float>(i) * 0.001f;
+						values[i] = std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+					}
+				});
+			});
+
+			if (threads == 1)
+			{
+				singleThreadMs = ms;
+			}
+			out << std::setw(7) << threads << std::setw(9) << ms << std::setw(8) << std::setprecision(2)
+				<< singleThreadMs / ms << "x\n" << std::setprecision(1);
+		}
+	}
+
+	std::vector<SorpBenchmarkScene> SorpBenchmark::defaultScenes()
+	{
+		return {
+			{ "baseline", 1, 1024, 1 },
+			{ "many_draws", 256, 16, 16 },
+			{ "many_instances", 1, 65536, 1 },
+			{ "mixed", 64, 256, 8 }
+		};
+	}
+
+	void SorpBenchmark::runRendering(const SorpAppSettings& base, uint32_t measuredFrames, std::ostream& out)
+	{
+		runRendering(base, measuredFrames, out, defaultScenes());
+	}
+
+	void SorpBenchmark::runRendering(const SorpAppSettings& base, uint32_t measuredFrames, std::ostream& out,
+		const std::vector<SorpBenchmarkScene>& scenes)
+	{
+		measuredFrames = std::max(measuredFrames, 1u);
+
+		out << std::fixed << std::setprecision(4);
+		out << "{\n";
+		for (size_t i = 0; i < scenes.size(); i++)
+		{
+			const SorpBenchmarkScene& scene = scenes[i];
+			SorpAppSettings settings = base;
+			settings.modelCount = scene.modelCount;
+			settings.instancesPerModel = scene.instancesPerModel;
+			settings.textureCount = scene.textureCount;
+
+			SorpSimpleApp app{ settings };
+			if (i == 0)
+			{
+				out << "  \"device\": ";
+				writeString(out, app.renderDevice().properties.deviceName);
+				out << ",\n";
+				out << "  \"frames\": " << measuredFrames << ",\n";
+				out << "  \"warmup_frames\": " << WARMUP_FRAMES << ",\n";
+				out << "  \"frames_in_flight\": " << settings.framesInFlight << ",\n";
+				out << "  \"min_draws_per_thread\": " << settings.minDrawsPerThread << ",\n";
+				out << "  \"headless\": " << (settings.headless ? "true" : "false") << ",\n";
+				out << "  \"scenes\": [\n";
+			}
+
+			// Lets the allocator, descriptor pools and caches reach their steady state before measuring
+			app.runFrames(WARMUP_FRAMES);
+			// Streamed assets still swapping in would skew the measured frames
+			while (app.pendingAssets() > 0)
+			{
+				app.runFrames(1);
+			}
+			SorpMemoryStats before = app.renderDevice().allocator().stats();
+			std::vector<SorpFrameStats> frames = app.runFrames(measuredFrames);
+			SorpMemoryStats after = app.renderDevice().allocator().stats();
+
+			std::vector<double> cpuMs;
+			std::vector<double> gpuMs;
+			for (const SorpFrameStats& frame : frames)
+			{
+				cpuMs.push_back(frame.cpuMs);
+				if (frame.gpuFresh)
+				{
+					gpuMs.push_back(frame.gpuMs);
+				}
+			}
+
+			out << "    {\n";
+			out << "      \"name\": ";
+			writeString(out, scene.name);
+			out << ",\n";
+			out << "      \"models\": " << scene.modelCount << ",\n";
+			out << "      \"instances_per_model\": " << scene.instancesPerModel << ",\n";
+			out << "      \"objects\": " << app.objectCount() << ",\n";
+			out << "      \"textures\": " << app.textureCount() << ",\n";
+			out << "      \"draw_calls_per_frame\": " << app.drawCallsPerFrame() << ",\n";
+			out << "      \"cpu_frame_ms\": ";
+			writeTimings(out, cpuMs);
+			out << ",\n      \"gpu_frame_ms\": ";
+			if (app.hasGpuTimings() && !gpuMs.empty())
+			{
+				writeTimings(out, gpuMs);
+			}
+			else
+			{
+				out << "null";
+			}
+			out << ",\n";
+			out << "      \"allocations\": { \"live\": " << after.allocationCount
+				<< ", \"during_run\": " << after.allocateCalls - before.allocateCalls
+				<< ", \"device_allocation_calls\": " << after.deviceAllocationCalls << " },\n";
+			out << "      \"memory\": { \"bytes_reserved\": " << after.bytesReserved
+				<< ", \"bytes_used\": " << after.bytesUsed << " }\n";
+			out << "    }" << (i + 1 < scenes.size() ? "," : "") << "\n";
+		}
+		out << (scenes.empty() ? "  \"scenes\": [\n" : "") << "  ]\n}\n";
+	}
+}
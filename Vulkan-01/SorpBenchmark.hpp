@@ -0,0 +1,36 @@
+#pragma once
+
+#include "SorpSimpleApp.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	struct SorpBenchmarkScene
+	{
+		std::string name;
+		uint32_t modelCount;
+		uint32_t instancesPerModel;
+		uint32_t textureCount;
+	};
+
+	class SorpBenchmark
+	{
+	public:
+		static constexpr uint32_t WARMUP_FRAMES = 50;
+		static constexpr uint32_t DEFAULT_MEASURED_FRAMES = 500;
+
+		// Per job scheduling overhead and parallelFor scaling from 1 to N threads. Needs no window or Vulkan device.
+		static void runJobSystem(std::ostream& out);
+
+		// Renders every scene with a fresh app built from base and writes one JSON report. Scenes are generated,
+		// not loaded, so the same arguments give the same workload on every run.
+		static void runRendering(const SorpAppSettings& base, uint32_t measuredFrames, std::ostream& out);
+		static void runRendering(const SorpAppSettings& base, uint32_t measuredFrames, std::ostream& out,
+			const std::vector<SorpBenchmarkScene>& scenes);
+
+		static std::vector<SorpBenchmarkScene> defaultScenes();
+	};
+}
@@ -0,0 +1,230 @@
+#include "SorpBindlessTable.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpBindlessTable::SorpBindlessTable(SorpRenderDevice& renderDevice, VkImageView defaultImageView, VkSampler defaultSampler,
+		uint32_t frameCount, uint32_t reservedStageResources) :
+		_renderDevice{renderDevice}, _bindless{renderDevice.descriptorIndexingEnabled}, _frameCount{frameCount}
+	{
+		// Every slot is a combined image sampler, so each one counts as a sampler, a sampled image and a stage resource
+		const VkPhysicalDeviceLimits& limits = renderDevice.properties.limits;
+		uint32_t stageResources = _bindless ? renderDevice.maxPerStageUpdateAfterBindResources : limits.maxPerStageResources;
+		if (stageResources <= reservedStageResources + DEFAULT_TEXTURE_SLOT + 1)
+		{
+			throw std::runtime_error("no per stage resources left for the texture table!");
+		}
+
+		_capacity = _bindless ?
+			std::min(MAX_TEXTURES, renderDevice.maxUpdateAfterBindCombinedImageSamplers) :
+			std::min({ FALLBACK_TEXTURES, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+				limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages });
+		_capacity = std::min(_capacity, stageResources - reservedStageResources);
+
+		createLayout();
+		createSets(defaultImageView, defaultSampler);
+
+		for (uint32_t slot = _capacity - 1; slot > DEFAULT_TEXTURE_SLOT; slot--)
+		{
+			_freeSlots.push_back(slot);
+		}
+	}
+
+	SorpBindlessTable::~SorpBindlessTable()
+	{
+		VkDevice device = _renderDevice.device();
+		VkDescriptorPool pool = _pool;
+		VkDescriptorSetLayout layout = _layout;
+		_renderDevice.deferDestroy([device, pool, layout]()
+		{
+			vkDestroyDescriptorPool(device, pool, nullptr);
+			vkDestroyDescriptorSetLayout(device, layout, nullptr);
+		});
+	}
+
+	uint32_t SorpBindlessTable::registerTexture(VkImageView imageView, VkSampler sampler)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_freeSlots.empty())
+		{
+			throw std::runtime_error("bindless texture table is full!");
+		}
+
+		uint32_t slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		queueWrite({ slot, imageView, sampler });
+		return slot;
+	}
+
+	void SorpBindlessTable::releaseTexture(uint32_t slot)
+	{
+		if (slot == DEFAULT_TEXTURE_SLOT)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_retiredSlots.push_back({ slot, _renderDevice.frameNumber() });
+	}
+
+	void SorpBindlessTable::beginFrame(uint32_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// A slot released during frame N was last sampled by frame N, which is done once its fence came around
+		uint64_t frameNumber = _renderDevice.frameNumber();
+		auto retired = std::remove_if(_retiredSlots.begin(), _retiredSlots.end(), [&](const RetiredSlot& retiredSlot)
+		{
+			if (retiredSlot.frame + _frameCount > frameNumber)
+			{
+				return false;
+			}
+			_freeSlots.push_back(retiredSlot.slot);
+			return true;
+		});
+		_retiredSlots.erase(retired, _retiredSlots.end());
+
+		if (!_bindless && !_pendingWrites[frameIndex].empty())
+		{
+			writeTextures(_sets[frameIndex], _pendingWrites[frameIndex]);
+			_pendingWrites[frameIndex].clear();
+		}
+	}
+
+	void SorpBindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setIndex, uint32_t frameIndex)
+	{
+		VkDescriptorSet set = _bindless ? _sets[0] : _sets[frameIndex];
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set, 0, nullptr);
+	}
+
+	void SorpBindlessTable::createLayout()
+	{
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = _capacity;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		binding.pImmutableSamplers = nullptr;
+
+		VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+			VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		bindingFlagsInfo.bindingCount = 1;
+		bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		if (_bindless)
+		{
+			layoutInfo.pNext = &bindingFlagsInfo;
+			layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		}
+
+		if (vkCreateDescriptorSetLayout(_renderDevice.device(), &layoutInfo, nullptr, &_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create bindless descriptor set layout!");
+		}
+	}
+
+	void SorpBindlessTable::createSets(VkImageView defaultImageView, VkSampler defaultSampler)
+	{
+		uint32_t setCount = _bindless ? 1 : _frameCount;
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = _capacity * setCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = _bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+		poolInfo.maxSets = setCount;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(_renderDevice.device(), &poolInfo, nullptr, &_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create bindless descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(setCount, _layout);
+		std::vector<uint32_t> descriptorCounts(setCount, _capacity);
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo{};
+		variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+		variableCountInfo.descriptorSetCount = setCount;
+		variableCountInfo.pDescriptorCounts = descriptorCounts.data();
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = _bindless ? &variableCountInfo : nullptr;
+		allocInfo.descriptorPool = _pool;
+		allocInfo.descriptorSetCount = setCount;
+		allocInfo.pSetLayouts = layouts.data();
+
+		_sets.resize(setCount);
+		if (vkAllocateDescriptorSets(_renderDevice.device(), &allocInfo, _sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate bindless descriptor sets!");
+		}
+
+		// Partially bound sets only need the default slot, fixed size ones have to be fully written
+		std::vector<TextureWrite> defaults;
+		uint32_t defaultCount = _bindless ? 1 : _capacity;
+		for (uint32_t slot = 0; slot < defaultCount; slot++)
+		{
+			defaults.push_back({ slot, defaultImageView, defaultSampler });
+		}
+		for (auto set : _sets)
+		{
+			writeTextures(set, defaults);
+		}
+
+		_pendingWrites.resize(_bindless ? 0 : _frameCount);
+	}
+
+	void SorpBindlessTable::writeTextures(VkDescriptorSet set, const std::vector<TextureWrite>& writes)
+	{
+		std::vector<VkDescriptorImageInfo> imageInfos(writes.size());
+		std::vector<VkWriteDescriptorSet> descriptorWrites(writes.size());
+		for (size_t i = 0; i < writes.size(); i++)
+		{
+			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfos[i].imageView = writes[i].imageView;
+			imageInfos[i].sampler = writes[i].sampler;
+
+			descriptorWrites[i] = {};
+			descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[i].dstSet = set;
+			descriptorWrites[i].dstBinding = 0;
+			descriptorWrites[i].dstArrayElement = writes[i].slot;
+			descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[i].descriptorCount = 1;
+			descriptorWrites[i].pImageInfo = &imageInfos[i];
+		}
+
+		vkUpdateDescriptorSets(_renderDevice.device(), static_cast<uint32_t>(descriptorWrites.size()),
+			descriptorWrites.data(), 0, nullptr);
+	}
+
+	void SorpBindlessTable::queueWrite(const TextureWrite& write)
+	{
+		if (_bindless)
+		{
+			// Fresh slots aren't used by any pending command buffer, which update unused while pending allows
+			writeTextures(_sets[0], { write });
+			return;
+		}
+
+		for (auto& pending : _pendingWrites)
+		{
+			pending.push_back(write);
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpFrameContext.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace sorp_v
+{
+	// Global texture table shaders index with a texture id, so changing textures between draws needs no
+	// descriptor rebind. With descriptor indexing it's a single update after bind, partially bound set; without
+	// it every frame in flight gets its own fixed size copy and writes are applied once that frame comes around.
+	class SorpBindlessTable
+	{
+	public:
+		static constexpr uint32_t MAX_TEXTURES = 4096;
+		// maxPerStageDescriptorSamplers is guaranteed to be at least 16
+		static constexpr uint32_t FALLBACK_TEXTURES = 16;
+		// Always holds the default texture, empty slots point to it in the fallback path
+		static constexpr uint32_t DEFAULT_TEXTURE_SLOT = 0;
+
+		// reservedStageResources: descriptors and color attachments the fragment stage of pipelines using the table
+		// already has outside of it, they count against the same per stage resource limit
+		SorpBindlessTable(SorpRenderDevice& renderDevice, VkImageView defaultImageView, VkSampler defaultSampler,
+			uint32_t frameCount = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT, uint32_t reservedStageResources = 0);
+		~SorpBindlessTable();
+
+		SorpBindlessTable(const SorpBindlessTable&) = delete;
+		SorpBindlessTable& operator=(const SorpBindlessTable&) = delete;
+
+		// Thread safe. The image has to be in SHADER_READ_ONLY_OPTIMAL by the time a draw samples it
+		uint32_t registerTexture(VkImageView imageView, VkSampler sampler);
+		// The slot is handed out again once every frame that may still sample it has retired
+		void releaseTexture(uint32_t slot);
+
+		// Call after the frame's fence was waited on
+		void beginFrame(uint32_t frameIndex);
+		void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setIndex, uint32_t frameIndex);
+
+		VkDescriptorSetLayout layout() const { return _layout; }
+		// Size of the shader side array, feed it to the TEXTURE_CAPACITY specialization constant
+		uint32_t capacity() const { return _capacity; }
+		bool isBindless() const { return _bindless; }
+		// Without shaderSampledImageArrayDynamicIndexing shaders may only index the table with constants, feed it to the
+		// DYNAMIC_INDEXING specialization constant so they stick to the default slot
+		bool supportsDynamicIndexing() const { return _renderDevice.enabledFeatures.shaderSampledImageArrayDynamicIndexing; }
+		// Whether the index may differ between the draws of a multi-draw (nonuniformEXT). Without it the index has to
+		// stay dynamically uniform, so draws with different textures can't share a multi-draw
+		bool supportsNonUniformIndexing() const { return _renderDevice.nonUniformSamplerIndexingEnabled; }
+
+	private:
+		struct TextureWrite
+		{
+			uint32_t slot;
+			VkImageView imageView;
+			VkSampler sampler;
+		};
+
+		struct RetiredSlot
+		{
+			uint32_t slot;
+			uint64_t frame;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		bool _bindless;
+		uint32_t _capacity;
+		uint32_t _frameCount;
+
+		VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+		VkDescriptorPool _pool = VK_NULL_HANDLE;
+		// One set when bindless, one per frame in flight otherwise
+		std::vector<VkDescriptorSet> _sets;
+
+		std::mutex _mutex;
+		std::vector<uint32_t> _freeSlots;
+		std::vector<RetiredSlot> _retiredSlots;
+		std::vector<std::vector<TextureWrite>> _pendingWrites;
+
+		void createLayout();
+		void createSets(VkImageView defaultImageView, VkSampler defaultSampler);
+		void writeTextures(VkDescriptorSet set, const std::vector<TextureWrite>& writes);
+		void queueWrite(const TextureWrite& write);
+	};
+}
@@ -0,0 +1,67 @@
+#include "SorpComputePipeline.hpp"
+
+#include "SorpPipeline.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpComputePipeline::SorpComputePipeline(SorpRenderDevice& renderDevice, const std::string& computeShader, VkPipelineLayout pipelineLayout) :
+		_renderDevice{renderDevice}
+	{
+		createComputePipeline(computeShader, pipelineLayout);
+	}
+
+	SorpComputePipeline::~SorpComputePipeline()
+	{
+		VkDevice device = _renderDevice.device();
+		VkShaderModule shaderModule = _computeShaderModule;
+		VkPipeline pipeline = _computePipeline;
+		_renderDevice.deferDestroy([device, shaderModule, pipeline]()
+		{
+			vkDestroyShaderModule(device, shaderModule, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
+	}
+
+	void SorpComputePipeline::bind(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipeline);
+	}
+
+	void SorpComputePipeline::createComputePipeline(const std::string& computeShader, VkPipelineLayout pipelineLayout)
+	{
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline. No pipelineLayout is specified");
+
+		auto code = SorpPipeline::readFile(computeShader);
+
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = code.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+		if (vkCreateShaderModule(_renderDevice.device(), &moduleInfo, nullptr, &_computeShaderModule) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shader model");
+		}
+
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module = _computeShaderModule;
+		shaderStage.pName = "main";
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = shaderStage;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		if (vkCreateComputePipelines(_renderDevice.device(), _renderDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &_computePipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute pipeline!");
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+
+#include <string>
+
+namespace sorp_v
+{
+	class SorpComputePipeline
+	{
+	public:
+		SorpComputePipeline(SorpRenderDevice& renderDevice, const std::string& computeShader, VkPipelineLayout pipelineLayout);
+		~SorpComputePipeline();
+
+		SorpComputePipeline(const SorpComputePipeline&) = delete;
+		SorpComputePipeline& operator=(const SorpComputePipeline&) = delete;
+
+		void bind(VkCommandBuffer commandBuffer);
+
+	private:
+		SorpRenderDevice& _renderDevice;
+		VkPipeline _computePipeline;
+		VkShaderModule _computeShaderModule;
+
+		void createComputePipeline(const std::string& computeShader, VkPipelineLayout pipelineLayout);
+	};
+}
@@ -0,0 +1,200 @@
+#include "SorpCpuProfiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace sorp_v
+{
+	namespace
+	{
+		// sequence is index + 1 of the event the slot holds and 0 while its thread rewrites it, so a dump can
+		// tell a finished event from one that was overwritten under it. The fields are atomics so that race
+		// stays defined, relaxed stores cost the same as plain ones
+		struct Event
+		{
+			std::atomic<uint64_t> sequence{ 0 };
+			std::atomic<const char*> name{ nullptr };
+			std::atomic<uint64_t> startNs{ 0 };
+			std::atomic<uint64_t> endNs{ 0 };
+		};
+
+		// Written by its thread only, read by writeChromeTrace while that thread keeps recording
+		struct ThreadBuffer
+		{
+			uint32_t threadId;
+			std::string name;
+			std::unique_ptr<Event[]> events{ new Event[SorpCpuProfiler::EVENTS_PER_THREAD] };
+			std::atomic<uint64_t> written{ 0 };
+		};
+
+		// Buffers are never freed, a thread that exited still shows up in the next dump
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+			std::set<std::string> gpuNames;
+			ThreadBuffer* gpuBuffer = nullptr;
+		};
+
+		const uint32_t GPU_THREAD_ID = 0;
+
+		thread_local ThreadBuffer* t_buffer = nullptr;
+
+		Registry& registry()
+		{
+			static Registry instance;
+			return instance;
+		}
+
+		ThreadBuffer* createBuffer(Registry& registry, uint32_t threadId, const std::string& name)
+		{
+			registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+			ThreadBuffer* buffer = registry.buffers.back().get();
+			buffer->threadId = threadId;
+			buffer->name = name;
+			return buffer;
+		}
+
+		ThreadBuffer& threadBuffer()
+		{
+			if (!t_buffer)
+			{
+				Registry& instance = registry();
+				std::lock_guard<std::mutex> lock(instance.mutex);
+				uint32_t threadId = static_cast<uint32_t>(instance.buffers.size()) + 1;
+				t_buffer = createBuffer(instance, threadId, "thread " + std::to_string(threadId));
+			}
+			return *t_buffer;
+		}
+
+		void push(ThreadBuffer& buffer, const char* name, uint64_t startNs, uint64_t endNs)
+		{
+			uint64_t index = buffer.written.load(std::memory_order_relaxed);
+			Event& event = buffer.events[index % SorpCpuProfiler::EVENTS_PER_THREAD];
+			event.sequence.store(0, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			event.name.store(name, std::memory_order_relaxed);
+			event.startNs.store(startNs, std::memory_order_relaxed);
+			event.endNs.store(endNs, std::memory_order_relaxed);
+			event.sequence.store(index + 1, std::memory_order_release);
+			buffer.written.store(index + 1, std::memory_order_release);
+		}
+
+		// False when the slot no longer holds event index, the writer lapped the dump while it was reading
+		bool read(const ThreadBuffer& buffer, uint64_t index, const char*& name, uint64_t& startNs, uint64_t& endNs)
+		{
+			const Event& event = buffer.events[index % SorpCpuProfiler::EVENTS_PER_THREAD];
+			if (event.sequence.load(std::memory_order_acquire) != index + 1)
+			{
+				return false;
+			}
+			name = event.name.load(std::memory_order_relaxed);
+			startNs = event.startNs.load(std::memory_order_relaxed);
+			endNs = event.endNs.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return event.sequence.load(std::memory_order_relaxed) == index + 1;
+		}
+
+		void writeJsonString(std::ostream& out, const char* text)
+		{
+			out << '"';
+			for (const char* c = text; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+				{
+					out << '\\';
+				}
+				out << *c;
+			}
+			out << '"';
+		}
+	}
+
+	void SorpCpuProfiler::record(const char* name, uint64_t startNs, uint64_t endNs)
+	{
+		push(threadBuffer(), name, startNs, endNs);
+	}
+
+	void SorpCpuProfiler::recordGpu(const std::string& name, uint64_t startNs, uint64_t endNs)
+	{
+		Registry& instance = registry();
+		const char* internedName;
+		{
+			std::lock_guard<std::mutex> lock(instance.mutex);
+			if (!instance.gpuBuffer)
+			{
+				instance.gpuBuffer = createBuffer(instance, GPU_THREAD_ID, "GPU");
+			}
+			internedName = instance.gpuNames.insert(name).first->c_str();
+		}
+		push(*instance.gpuBuffer, internedName, startNs, endNs);
+	}
+
+	void SorpCpuProfiler::setThreadName(const std::string& name)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		buffer.name = name;
+	}
+
+	void SorpCpuProfiler::writeChromeTrace(std::ostream& out)
+	{
+		Registry& instance = registry();
+		std::lock_guard<std::mutex> lock(instance.mutex);
+
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		out << std::fixed << std::setprecision(3);
+		for (const auto& buffer : instance.buffers)
+		{
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+			writeJsonString(out, buffer->name.c_str());
+			out << "}}";
+
+			uint64_t written = buffer->written.load(std::memory_order_acquire);
+			uint64_t begin = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+			for (uint64_t i = begin; i < written; i++)
+			{
+				const char* name;
+				uint64_t startNs;
+				uint64_t endNs;
+				if (!read(*buffer, i, name, startNs, endNs))
+				{
+					continue;
+				}
+				out << ",\n{\"name\":";
+				writeJsonString(out, name);
+				out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+					<< ",\"ts\":" << startNs / 1000.0
+					<< ",\"dur\":" << (endNs - startNs) / 1000.0 << "}";
+			}
+		}
+		out << "\n]}\n";
+	}
+
+	void SorpCpuProfiler::writeChromeTrace(const std::string& path)
+	{
+		std::ofstream file{ path, std::ios::trunc };
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open trace file: " + path);
+		}
+		writeChromeTrace(file);
+	}
+
+	uint64_t SorpCpuProfiler::nowNs()
+	{
+		static const auto start = std::chrono::steady_clock::now();
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+}
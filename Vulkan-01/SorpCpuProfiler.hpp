@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace sorp_v
+{
+	// Collects timed CPU scopes into a ring per thread and writes them out as Chrome trace JSON, which
+	// chrome://tracing and ui.perfetto.dev open. Recording never locks, only the first event of a thread
+	// registers its buffer. Each ring keeps the most recent EVENTS_PER_THREAD events.
+	class SorpCpuProfiler
+	{
+	public:
+		static constexpr uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+		// name has to outlive the profiler, string literals are the intended use
+		static void record(const char* name, uint64_t startNs, uint64_t endNs);
+		// Places a GPU scope on its own track, startNs is on the nowNs() clock
+		static void recordGpu(const std::string& name, uint64_t startNs, uint64_t endNs);
+		// Shows up as the track name of the calling thread
+		static void setThreadName(const std::string& name);
+
+		// Safe while other threads record, events they overwrite during the dump are left out
+		static void writeChromeTrace(std::ostream& out);
+		static void writeChromeTrace(const std::string& path);
+
+		static uint64_t nowNs();
+	};
+
+	class SorpCpuScope
+	{
+	public:
+		explicit SorpCpuScope(const char* name) : _name{name}, _start{SorpCpuProfiler::nowNs()} {}
+		~SorpCpuScope() { SorpCpuProfiler::record(_name, _start, SorpCpuProfiler::nowNs()); }
+
+		SorpCpuScope(const SorpCpuScope&) = delete;
+		SorpCpuScope& operator=(const SorpCpuScope&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _start;
+	};
+}
+
+#define SORP_PROFILE_CONCAT_INNER(a, b) a##b
+#define SORP_PROFILE_CONCAT(a, b) SORP_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef SORP_DISABLE_PROFILING
+#define SORP_PROFILE_SCOPE(name)
+#else
+#define SORP_PROFILE_SCOPE(name) ::sorp_v::SorpCpuScope SORP_PROFILE_CONCAT(_sorpProfileScope, __LINE__){ name }
+#endif
@@ -0,0 +1,205 @@
+#include "SorpDescriptorAllocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	const std::vector<SorpDescriptorAllocator::PoolSizeRatio> SorpDescriptorAllocator::DEFAULT_POOL_RATIOS = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f }
+	};
+
+	SorpDescriptorAllocator::SorpDescriptorAllocator(SorpRenderDevice& renderDevice, const std::vector<PoolSizeRatio>& poolRatios) :
+		_renderDevice{renderDevice}, _poolRatios{poolRatios}
+	{
+	}
+
+	SorpDescriptorAllocator::~SorpDescriptorAllocator()
+	{
+		VkDevice device = _renderDevice.device();
+		std::vector<VkDescriptorPool> pools = _fullPools;
+		pools.insert(pools.end(), _readyPools.begin(), _readyPools.end());
+		if (_currentPool != VK_NULL_HANDLE)
+		{
+			pools.push_back(_currentPool);
+		}
+
+		_renderDevice.deferDestroy([device, pools]()
+		{
+			for (auto pool : pools)
+			{
+				vkDestroyDescriptorPool(device, pool, nullptr);
+			}
+		});
+	}
+
+	VkDescriptorSet SorpDescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+	{
+		if (_currentPool == VK_NULL_HANDLE)
+		{
+			_currentPool = acquirePool();
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = _currentPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(_renderDevice.device(), &allocInfo, &set);
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+		{
+			_fullPools.push_back(_currentPool);
+			_currentPool = acquirePool();
+
+			allocInfo.descriptorPool = _currentPool;
+			result = vkAllocateDescriptorSets(_renderDevice.device(), &allocInfo, &set);
+		}
+
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate descriptor set!");
+		}
+		return set;
+	}
+
+	void SorpDescriptorAllocator::reset()
+	{
+		if (_currentPool != VK_NULL_HANDLE)
+		{
+			_fullPools.push_back(_currentPool);
+			_currentPool = VK_NULL_HANDLE;
+		}
+
+		for (auto pool : _fullPools)
+		{
+			vkResetDescriptorPool(_renderDevice.device(), pool, 0);
+			_readyPools.push_back(pool);
+		}
+		_fullPools.clear();
+	}
+
+	VkDescriptorPool SorpDescriptorAllocator::acquirePool()
+	{
+		if (!_readyPools.empty())
+		{
+			VkDescriptorPool pool = _readyPools.back();
+			_readyPools.pop_back();
+			return pool;
+		}
+
+		VkDescriptorPool pool = createPool(_setsPerPool);
+		_setsPerPool = std::min(_setsPerPool * 2, MAX_SETS_PER_POOL);
+		return pool;
+	}
+
+	VkDescriptorPool SorpDescriptorAllocator::createPool(uint32_t setCount)
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const auto& ratio : _poolRatios)
+		{
+			poolSizes.push_back({ ratio.type, std::max(1u, static_cast<uint32_t>(ratio.descriptorsPerSet * setCount)) });
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = setCount;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(_renderDevice.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+		return pool;
+	}
+
+	SorpDescriptorUpdateTemplate::SorpDescriptorUpdateTemplate(SorpRenderDevice& renderDevice, VkDescriptorSetLayout layout,
+		const std::vector<VkDescriptorUpdateTemplateEntry>& entries) :
+		_renderDevice{renderDevice}, _entries{entries}
+	{
+		if (renderDevice.properties.apiVersion < VK_API_VERSION_1_1)
+		{
+			return;
+		}
+
+		VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+		templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(_entries.size());
+		templateInfo.pDescriptorUpdateEntries = _entries.data();
+		templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateInfo.descriptorSetLayout = layout;
+
+		if (vkCreateDescriptorUpdateTemplate(_renderDevice.device(), &templateInfo, nullptr, &_template) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor update template!");
+		}
+	}
+
+	SorpDescriptorUpdateTemplate::~SorpDescriptorUpdateTemplate()
+	{
+		if (_template != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorUpdateTemplate(_renderDevice.device(), _template, nullptr);
+		}
+	}
+
+	void SorpDescriptorUpdateTemplate::update(VkDescriptorSet set, const void* data)
+	{
+		if (_template != VK_NULL_HANDLE)
+		{
+			vkUpdateDescriptorSetWithTemplate(_renderDevice.device(), set, _template, data);
+		}
+		else
+		{
+			updateWithWrites(set, data);
+		}
+	}
+
+	void SorpDescriptorUpdateTemplate::updateWithWrites(VkDescriptorSet set, const void* data)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		std::vector<VkWriteDescriptorSet> descriptorWrites;
+		for (const auto& entry : _entries)
+		{
+			for (uint32_t i = 0; i < entry.descriptorCount; i++)
+			{
+				const void* element = bytes + entry.offset + entry.stride * i;
+
+				VkWriteDescriptorSet descriptorWrite{};
+				descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrite.dstSet = set;
+				descriptorWrite.dstBinding = entry.dstBinding;
+				descriptorWrite.dstArrayElement = entry.dstArrayElement + i;
+				descriptorWrite.descriptorType = entry.descriptorType;
+				descriptorWrite.descriptorCount = 1;
+
+				switch (entry.descriptorType)
+				{
+				case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+				case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+				case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+				case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+					descriptorWrite.pBufferInfo = static_cast<const VkDescriptorBufferInfo*>(element);
+					break;
+				case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+				case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+					descriptorWrite.pTexelBufferView = static_cast<const VkBufferView*>(element);
+					break;
+				default:
+					descriptorWrite.pImageInfo = static_cast<const VkDescriptorImageInfo*>(element);
+					break;
+				}
+				descriptorWrites.push_back(descriptorWrite);
+			}
+		}
+
+		vkUpdateDescriptorSets(_renderDevice.device(), static_cast<uint32_t>(descriptorWrites.size()),
+			descriptorWrites.data(), 0, nullptr);
+	}
+}
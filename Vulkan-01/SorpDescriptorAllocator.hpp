@@ -0,0 +1,71 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+
+#include <vector>
+
+namespace sorp_v
+{
+	// Hands out descriptor sets from a chain of pools, a new and larger pool is added whenever the current one
+	// runs dry. Sets are never freed one by one, reset() recycles every pool at once, which makes per frame
+	// transient sets close to free.
+	class SorpDescriptorAllocator
+	{
+	public:
+		struct PoolSizeRatio
+		{
+			VkDescriptorType type;
+			float descriptorsPerSet;
+		};
+
+		static constexpr uint32_t INITIAL_SETS_PER_POOL = 64;
+		static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+		static const std::vector<PoolSizeRatio> DEFAULT_POOL_RATIOS;
+
+		SorpDescriptorAllocator(SorpRenderDevice& renderDevice, const std::vector<PoolSizeRatio>& poolRatios = DEFAULT_POOL_RATIOS);
+		~SorpDescriptorAllocator();
+
+		SorpDescriptorAllocator(const SorpDescriptorAllocator&) = delete;
+		SorpDescriptorAllocator& operator=(const SorpDescriptorAllocator&) = delete;
+
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+		// Every set allocated so far becomes invalid, nothing submitted may still use them
+		void reset();
+
+	private:
+		SorpRenderDevice& _renderDevice;
+		std::vector<PoolSizeRatio> _poolRatios;
+		uint32_t _setsPerPool = INITIAL_SETS_PER_POOL;
+
+		std::vector<VkDescriptorPool> _fullPools;
+		std::vector<VkDescriptorPool> _readyPools;
+		VkDescriptorPool _currentPool = VK_NULL_HANDLE;
+
+		VkDescriptorPool acquirePool();
+		VkDescriptorPool createPool(uint32_t setCount);
+	};
+
+	// Writes a whole descriptor set from one packed struct with vkUpdateDescriptorSetWithTemplate. Devices older
+	// than Vulkan 1.1 get the same entries replayed through vkUpdateDescriptorSets.
+	class SorpDescriptorUpdateTemplate
+	{
+	public:
+		// Entry offsets and strides point into the data passed to update, at VkDescriptorImageInfo,
+		// VkDescriptorBufferInfo or VkBufferView depending on the descriptor type
+		SorpDescriptorUpdateTemplate(SorpRenderDevice& renderDevice, VkDescriptorSetLayout layout,
+			const std::vector<VkDescriptorUpdateTemplateEntry>& entries);
+		~SorpDescriptorUpdateTemplate();
+
+		SorpDescriptorUpdateTemplate(const SorpDescriptorUpdateTemplate&) = delete;
+		SorpDescriptorUpdateTemplate& operator=(const SorpDescriptorUpdateTemplate&) = delete;
+
+		void update(VkDescriptorSet set, const void* data);
+
+	private:
+		SorpRenderDevice& _renderDevice;
+		std::vector<VkDescriptorUpdateTemplateEntry> _entries;
+		VkDescriptorUpdateTemplate _template = VK_NULL_HANDLE;
+
+		void updateWithWrites(VkDescriptorSet set, const void* data);
+	};
+}
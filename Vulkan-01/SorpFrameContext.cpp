@@ -0,0 +1,148 @@
+#include "SorpFrameContext.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <limits>
+#include <string>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpFrameRing::SorpFrameRing(SorpRenderDevice& renderDevice, uint32_t framesInFlight, VkDeviceSize uniformBytesPerFrame) :
+		_renderDevice{renderDevice}
+	{
+		if (framesInFlight < MIN_FRAMES_IN_FLIGHT || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+		{
+			throw std::runtime_error("frames in flight has to be between " + std::to_string(MIN_FRAMES_IN_FLIGHT) +
+				" and " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+		}
+
+		createFrames(framesInFlight);
+		createUniformBuffer(uniformBytesPerFrame);
+	}
+
+	SorpFrameRing::~SorpFrameRing()
+	{
+		VkDevice device = _renderDevice.device();
+		for (auto& frame : _frames)
+		{
+			VkCommandPool commandPool = frame.commandPool;
+			VkFence fence = frame.inFlightFence;
+			VkSemaphore imageAvailable = frame.imageAvailableSemaphore;
+			frame.descriptorAllocator.reset();
+			_renderDevice.deferDestroy([device, commandPool, fence, imageAvailable]()
+			{
+				vkDestroyCommandPool(device, commandPool, nullptr);
+				vkDestroyFence(device, fence, nullptr);
+				vkDestroySemaphore(device, imageAvailable, nullptr);
+			});
+		}
+		_renderDevice.deferDestroyBuffer(_uniformBuffer, _uniformAllocation);
+	}
+
+	SorpFrameContext& SorpFrameRing::beginFrame()
+	{
+		SorpFrameContext& frame = _frames[_currentFrame];
+		{
+			SORP_PROFILE_SCOPE("wait frame fence");
+			vkWaitForFences(_renderDevice.device(), 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+
+		// The fence belonged to the frame submitted framesInFlight frames ago
+		uint64_t frameNumber = _renderDevice.frameNumber();
+		if (frameNumber >= _frames.size())
+		{
+			_renderDevice.collectDeletions(frameNumber - _frames.size());
+		}
+
+		vkResetCommandPool(_renderDevice.device(), frame.commandPool, 0);
+		frame.uniformUsed = 0;
+		frame.descriptorAllocator->reset();
+		return frame;
+	}
+
+	SorpUniformAllocation SorpFrameRing::allocateUniform(SorpFrameContext& frame, VkDeviceSize size)
+	{
+		VkDeviceSize offset = (frame.uniformUsed + _uniformAlignment - 1) / _uniformAlignment * _uniformAlignment;
+		if (offset + size > frame.uniformSize)
+		{
+			throw std::runtime_error("frame uniform ring is full!");
+		}
+		frame.uniformUsed = offset + size;
+
+		SorpUniformAllocation allocation{};
+		allocation.dynamicOffset = static_cast<uint32_t>(offset);
+		allocation.mapped = static_cast<char*>(frame.uniformMapped) + offset;
+		return allocation;
+	}
+
+	void SorpFrameRing::endFrame()
+	{
+		_renderDevice.endFrame();
+		_currentFrame = (_currentFrame + 1) % _frames.size();
+	}
+
+	void SorpFrameRing::createFrames(uint32_t framesInFlight)
+	{
+		QueueFamilyIndices queueFamilyIndices = _renderDevice.findPhysicalQueueFamilies();
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		_frames.resize(framesInFlight);
+		for (uint32_t i = 0; i < framesInFlight; i++)
+		{
+			SorpFrameContext& frame = _frames[i];
+			frame.index = i;
+
+			if (vkCreateCommandPool(_renderDevice.device(), &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create command pool!");
+			}
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = frame.commandPool;
+			allocInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(_renderDevice.device(), &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failled to allocate command buffer");
+			}
+
+			if (vkCreateSemaphore(_renderDevice.device(), &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+				vkCreateFence(_renderDevice.device(), &fenceInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create synchronization objects for a frame!");
+			}
+
+			frame.descriptorAllocator = std::make_unique<SorpDescriptorAllocator>(_renderDevice);
+		}
+	}
+
+	void SorpFrameRing::createUniformBuffer(VkDeviceSize uniformBytesPerFrame)
+	{
+		_uniformAlignment = _renderDevice.properties.limits.minUniformBufferOffsetAlignment;
+		VkDeviceSize sliceSize = (uniformBytesPerFrame + _uniformAlignment - 1) / _uniformAlignment * _uniformAlignment;
+
+		_renderDevice.createBuffer(sliceSize * _frames.size(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_uniformBuffer, _uniformAllocation);
+
+		for (auto& frame : _frames)
+		{
+			frame.uniformOffset = sliceSize * frame.index;
+			frame.uniformSize = sliceSize;
+			frame.uniformMapped = static_cast<char*>(_uniformAllocation.mapped) + frame.uniformOffset;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpDescriptorAllocator.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace sorp_v
+{
+	// Everything one frame in flight records into or reads from. A context is only touched by the CPU again
+	// after its fence signaled, so frame N + 1 can be recorded while the GPU still executes frame N.
+	struct SorpFrameContext
+	{
+		uint32_t index = 0;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence inFlightFence = VK_NULL_HANDLE;
+		VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+
+		// Slice of SorpFrameRing::uniformBuffer() owned by this frame, bump allocated through allocateUniform
+		// and bound as a dynamic uniform buffer with the slice start as its base offset
+		VkDeviceSize uniformOffset = 0;
+		VkDeviceSize uniformSize = 0;
+		VkDeviceSize uniformUsed = 0;
+		void* uniformMapped = nullptr;
+
+		// Transient sets for this frame only, reset wholesale in beginFrame
+		std::unique_ptr<SorpDescriptorAllocator> descriptorAllocator;
+	};
+
+	struct SorpUniformAllocation
+	{
+		// Offset from the frame's slice start, pass it to vkCmdBindDescriptorSets as the dynamic offset
+		uint32_t dynamicOffset;
+		void* mapped;
+	};
+
+	class SorpFrameRing
+	{
+	public:
+		static constexpr uint32_t MIN_FRAMES_IN_FLIGHT = 2;
+		static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+		static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+		static constexpr VkDeviceSize DEFAULT_UNIFORM_BYTES_PER_FRAME = 256 * 1024;
+
+		SorpFrameRing(SorpRenderDevice& renderDevice, uint32_t framesInFlight,
+			VkDeviceSize uniformBytesPerFrame = DEFAULT_UNIFORM_BYTES_PER_FRAME);
+		~SorpFrameRing();
+
+		SorpFrameRing(const SorpFrameRing&) = delete;
+		SorpFrameRing& operator=(const SorpFrameRing&) = delete;
+
+		// Waits for the context's previous use to finish, releases deferred deletions that are now safe and
+		// resets the command pool, uniform slice and descriptor allocator
+		SorpFrameContext& beginFrame();
+		// Call once the frame's command buffer has been submitted
+		void endFrame();
+
+		// Aligned to minUniformBufferOffsetAlignment, valid until the frame comes around again
+		SorpUniformAllocation allocateUniform(SorpFrameContext& frame, VkDeviceSize size);
+
+		uint32_t framesInFlight() const { return static_cast<uint32_t>(_frames.size()); }
+		SorpFrameContext& frame(uint32_t index) { return _frames[index]; }
+		SorpFrameContext& currentFrame() { return _frames[_currentFrame]; }
+		VkBuffer uniformBuffer() const { return _uniformBuffer; }
+
+	private:
+		SorpRenderDevice& _renderDevice;
+		std::vector<SorpFrameContext> _frames;
+		uint32_t _currentFrame = 0;
+
+		VkBuffer _uniformBuffer = VK_NULL_HANDLE;
+		VkDeviceSize _uniformAlignment = 0;
+		SorpAllocation _uniformAllocation;
+
+		void createFrames(uint32_t framesInFlight);
+		void createUniformBuffer(VkDeviceSize uniformBytesPerFrame);
+	};
+}
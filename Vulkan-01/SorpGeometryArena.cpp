@@ -0,0 +1,172 @@
+#include "SorpGeometryArena.hpp"
+
+#include "SorpUploadQueue.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpGeometryArena::SorpGeometryArena(SorpRenderDevice& renderDevice, VkDeviceSize vertexStride,
+		uint32_t vertexCapacity, uint32_t indexCapacity) :
+		_renderDevice{renderDevice}, _vertexStride{vertexStride}
+	{
+		// On unified memory the GPU reads host visible memory at full speed, so skip the staging copy
+		_hostVisible = _renderDevice.allocator().isUnifiedMemory();
+
+		createArenaBuffer(_vertexStride * vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, _vertexBuffer, _vertexAllocation);
+		createArenaBuffer(sizeof(uint16_t) * indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, _indexBuffer, _indexAllocation);
+
+		_vertexSpace.reset(vertexCapacity);
+		_indexSpace.reset(indexCapacity);
+	}
+
+	SorpGeometryArena::~SorpGeometryArena()
+	{
+		_renderDevice.deferDestroyBuffer(_vertexBuffer, _vertexAllocation);
+		_renderDevice.deferDestroyBuffer(_indexBuffer, _indexAllocation);
+	}
+
+	SorpGeometryArena::Range SorpGeometryArena::allocateVertices(const void* vertices, uint32_t vertexCount)
+	{
+		Range range{};
+		range.count = vertexCount;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_vertexSpace.allocate(vertexCount, range.first))
+			{
+				throw std::runtime_error("geometry arena is out of vertex space!");
+			}
+		}
+
+		write(_vertexBuffer, _vertexAllocation, _vertexStride * range.first, vertices, _vertexStride * vertexCount);
+		return range;
+	}
+
+	SorpGeometryArena::Range SorpGeometryArena::allocateIndices(const uint16_t* indices, uint32_t indexCount)
+	{
+		Range range{};
+		range.count = indexCount;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_indexSpace.allocate(indexCount, range.first))
+			{
+				throw std::runtime_error("geometry arena is out of index space!");
+			}
+		}
+
+		write(_indexBuffer, _indexAllocation, sizeof(uint16_t) * range.first, indices, sizeof(uint16_t) * indexCount);
+		return range;
+	}
+
+	void SorpGeometryArena::freeVertices(const Range& range)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_vertexSpace.release(range.first, range.count);
+	}
+
+	void SorpGeometryArena::freeIndices(const Range& range)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_indexSpace.release(range.first, range.count);
+	}
+
+	void SorpGeometryArena::bind(VkCommandBuffer commandBuffer)
+	{
+		VkBuffer vertexBuffers[] = { _vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+	}
+
+	void SorpGeometryArena::createArenaBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, SorpAllocation& allocation)
+	{
+		if (_hostVisible)
+		{
+			_renderDevice.createBuffer(size,
+				usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				buffer,
+				allocation);
+			return;
+		}
+
+		_renderDevice.createBuffer(size,
+			usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			buffer,
+			allocation);
+	}
+
+	void SorpGeometryArena::write(VkBuffer buffer, const SorpAllocation& allocation, VkDeviceSize offset, const void* data, VkDeviceSize size)
+	{
+		if (_hostVisible)
+		{
+			memcpy(static_cast<char*>(allocation.mapped) + offset, data, (size_t)size);
+			return;
+		}
+
+		_renderDevice.uploadQueue().uploadBuffer(buffer, offset, data, size);
+	}
+
+	void SorpGeometryArena::FreeList::reset(uint32_t capacity)
+	{
+		freeRanges.clear();
+		freeRanges[0] = capacity;
+		used = 0;
+	}
+
+	bool SorpGeometryArena::FreeList::allocate(uint32_t count, uint32_t& first)
+	{
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second < count)
+			{
+				continue;
+			}
+
+			first = it->first;
+			uint32_t remaining = it->second - count;
+			freeRanges.erase(it);
+			if (remaining > 0)
+			{
+				freeRanges[first + count] = remaining;
+			}
+
+			used += count;
+			return true;
+		}
+		return false;
+	}
+
+	void SorpGeometryArena::FreeList::release(uint32_t first, uint32_t count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		used -= count;
+
+		auto next = freeRanges.lower_bound(first);
+		if (next != freeRanges.end() && first + count == next->first)
+		{
+			count += next->second;
+			next = freeRanges.erase(next);
+		}
+
+		if (next != freeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == first)
+			{
+				previous->second += count;
+				return;
+			}
+		}
+
+		freeRanges[first] = count;
+	}
+}
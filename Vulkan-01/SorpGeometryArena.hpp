@@ -0,0 +1,74 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace sorp_v
+{
+	// Packs the vertices and indices of many meshes into one shared vertex buffer and one shared index buffer.
+	// Meshes are addressed through firstIndex/vertexOffset, so a single bind covers every mesh in the arena.
+	class SorpGeometryArena
+	{
+	public:
+		// Offsets and counts are in elements (vertices or indices), not bytes
+		struct Range
+		{
+			uint32_t first = 0;
+			uint32_t count = 0;
+		};
+
+		static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 1024 * 1024;
+		static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 4 * 1024 * 1024;
+
+		SorpGeometryArena(SorpRenderDevice& renderDevice, VkDeviceSize vertexStride,
+			uint32_t vertexCapacity = DEFAULT_VERTEX_CAPACITY, uint32_t indexCapacity = DEFAULT_INDEX_CAPACITY);
+		~SorpGeometryArena();
+
+		SorpGeometryArena(const SorpGeometryArena&) = delete;
+		SorpGeometryArena& operator=(const SorpGeometryArena&) = delete;
+
+		Range allocateVertices(const void* vertices, uint32_t vertexCount);
+		Range allocateIndices(const uint16_t* indices, uint32_t indexCount);
+		// Freed ranges are reused right away, the caller must make sure no submitted frame still reads them
+		void freeVertices(const Range& range);
+		void freeIndices(const Range& range);
+
+		void bind(VkCommandBuffer commandBuffer);
+
+		SorpRenderDevice& renderDevice() { return _renderDevice; }
+		VkBuffer vertexBuffer() const { return _vertexBuffer; }
+		VkBuffer indexBuffer() const { return _indexBuffer; }
+		uint32_t usedVertices() const { return _vertexSpace.used; }
+		uint32_t usedIndices() const { return _indexSpace.used; }
+
+	private:
+		// First fit free list over [0, capacity), neighbouring free ranges are merged on release
+		struct FreeList
+		{
+			std::map<uint32_t, uint32_t> freeRanges;
+			uint32_t used = 0;
+
+			void reset(uint32_t capacity);
+			bool allocate(uint32_t count, uint32_t& first);
+			void release(uint32_t first, uint32_t count);
+		};
+
+		SorpRenderDevice& _renderDevice;
+		VkDeviceSize _vertexStride;
+		bool _hostVisible;
+
+		VkBuffer _vertexBuffer;
+		SorpAllocation _vertexAllocation;
+		VkBuffer _indexBuffer;
+		SorpAllocation _indexAllocation;
+
+		std::mutex _mutex;
+		FreeList _vertexSpace;
+		FreeList _indexSpace;
+
+		void createArenaBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, SorpAllocation& allocation);
+		void write(VkBuffer buffer, const SorpAllocation& allocation, VkDeviceSize offset, const void* data, VkDeviceSize size);
+	};
+}
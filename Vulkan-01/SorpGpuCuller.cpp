@@ -0,0 +1,354 @@
+#include "SorpGpuCuller.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpGpuCuller::SorpGpuCuller(SorpRenderDevice& renderDevice, const std::string& cullShader, uint32_t maxObjects, uint32_t frameCount) :
+		_renderDevice{renderDevice}, _maxObjects{maxObjects}
+	{
+		createDescriptorSetLayout();
+		createPipelineLayout();
+		_cullPipeline = std::make_unique<SorpComputePipeline>(_renderDevice, cullShader, _pipelineLayout);
+
+		createFrameResources(frameCount);
+		createDescriptorSets();
+	}
+
+	SorpGpuCuller::~SorpGpuCuller()
+	{
+		for (auto& frame : _frames)
+		{
+			_renderDevice.deferDestroyBuffer(frame.objectBuffer, frame.objectAllocation);
+			_renderDevice.deferDestroyBuffer(frame.indirectBuffer, frame.indirectAllocation);
+			_renderDevice.deferDestroyBuffer(frame.instanceBuffer, frame.instanceAllocation);
+		}
+
+		_cullPipeline.reset();
+		VkDevice device = _renderDevice.device();
+		VkDescriptorPool descriptorPool = _descriptorPool;
+		VkPipelineLayout pipelineLayout = _pipelineLayout;
+		VkDescriptorSetLayout descriptorSetLayout = _descriptorSetLayout;
+		_renderDevice.deferDestroy([device, descriptorPool, pipelineLayout, descriptorSetLayout]()
+		{
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		});
+	}
+
+	uint32_t SorpGpuCuller::addDraw(const SorpModel& model, uint32_t maxInstances)
+	{
+		if (_draws.size() >= MAX_DRAWS || _reservedInstances + maxInstances > _maxObjects)
+		{
+			throw std::runtime_error("gpu culler is out of draw slots!");
+		}
+
+		Draw draw{};
+		draw.instanceBase = _reservedInstances;
+		draw.maxInstances = maxInstances;
+		_reservedInstances += maxInstances;
+
+		// Without drawIndirectFirstInstance firstInstance must stay 0, draw() offsets the instance binding instead
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = model.indexCount();
+		command.instanceCount = 0;
+		command.firstIndex = model.firstIndex();
+		command.vertexOffset = model.vertexOffset();
+		command.firstInstance = _renderDevice.enabledFeatures.drawIndirectFirstInstance ? draw.instanceBase : 0;
+
+		_commands.push_back(command);
+		_draws.push_back(draw);
+		return static_cast<uint32_t>(_draws.size() - 1);
+	}
+
+	void SorpGpuCuller::setDrawModel(uint32_t drawIndex, const SorpModel& model)
+	{
+		assert(drawIndex < _draws.size() && "Unknown draw");
+
+		VkDrawIndexedIndirectCommand& command = _commands[drawIndex];
+		command.indexCount = model.indexCount();
+		command.firstIndex = model.firstIndex();
+		command.vertexOffset = model.vertexOffset();
+	}
+
+	void SorpGpuCuller::setDrawMaterial(uint32_t drawIndex, uint32_t material)
+	{
+		assert(drawIndex < _draws.size() && "Unknown draw");
+		_draws[drawIndex].material = material;
+	}
+
+	void SorpGpuCuller::writeObjects(uint32_t frameIndex, const std::vector<ObjectData>& objects)
+	{
+		assert(objects.size() <= _maxObjects && "Too many objects for the gpu culler");
+
+		FrameResources& frame = _frames[frameIndex];
+		auto* mapped = static_cast<ObjectData*>(frame.objectAllocation.mapped);
+		memcpy(mapped, objects.data(), sizeof(ObjectData) * objects.size());
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			assert(objects[i].drawIndex < _draws.size() && "Object references an unknown draw");
+			const Draw& draw = _draws[objects[i].drawIndex];
+			mapped[i].instanceBase = draw.instanceBase;
+			mapped[i].maxInstances = draw.maxInstances;
+		}
+
+#ifndef NDEBUG
+		std::vector<uint32_t> drawObjects(_draws.size(), 0);
+		for (const auto& object : objects)
+		{
+			assert(++drawObjects[object.drawIndex] <= _draws[object.drawIndex].maxInstances && "Draw has more objects than maxInstances");
+		}
+#endif
+		frame.objectCount = static_cast<uint32_t>(objects.size());
+	}
+
+	void SorpGpuCuller::cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection)
+	{
+		FrameResources& frame = _frames[frameIndex];
+		VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * _draws.size();
+		if (commandsSize == 0)
+		{
+			return;
+		}
+
+		// Captured at record time, so changing a draw's model never affects frames already in flight
+		vkCmdUpdateBuffer(commandBuffer, frame.indirectBuffer, 0, commandsSize, _commands.data());
+
+		VkBufferMemoryBarrier resetBarrier{};
+		resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		resetBarrier.buffer = frame.indirectBuffer;
+		resetBarrier.offset = 0;
+		resetBarrier.size = commandsSize;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 1, &resetBarrier, 0, nullptr);
+
+		if (frame.objectCount > 0)
+		{
+			// Gribb/Hartmann plane extraction, the rows of the view projection matrix give the clip planes
+			CullConstants constants{};
+			glm::vec4 rows[4];
+			for (int i = 0; i < 4; i++)
+			{
+				rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+			}
+			constants.frustumPlanes[0] = rows[3] + rows[0];
+			constants.frustumPlanes[1] = rows[3] - rows[0];
+			constants.frustumPlanes[2] = rows[3] + rows[1];
+			constants.frustumPlanes[3] = rows[3] - rows[1];
+			constants.frustumPlanes[4] = rows[2];
+			constants.frustumPlanes[5] = rows[3] - rows[2];
+			for (auto& plane : constants.frustumPlanes)
+			{
+				plane = plane / glm::length(glm::vec3(plane));
+			}
+			constants.objectCount = frame.objectCount;
+
+			_cullPipeline->bind(commandBuffer);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1,
+				&frame.descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+			vkCmdDispatch(commandBuffer, (frame.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+		}
+
+		std::array<VkBufferMemoryBarrier, 2> drawBarriers{};
+		drawBarriers[0] = resetBarrier;
+		drawBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		drawBarriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+		drawBarriers[1] = drawBarriers[0];
+		drawBarriers[1].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		drawBarriers[1].buffer = frame.instanceBuffer;
+		drawBarriers[1].size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0, 0, nullptr, static_cast<uint32_t>(drawBarriers.size()), drawBarriers.data(), 0, nullptr);
+	}
+
+	void SorpGpuCuller::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t firstDraw, uint32_t count, bool splitMaterials)
+	{
+		assert(firstDraw + count <= drawCount() && "Draw range out of bounds");
+
+		FrameResources& frame = _frames[frameIndex];
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		// The draw count is fixed by the slot layout, so the Count variant would only save the empty slots
+		if (supportsMultiDrawIndirect(count))
+		{
+			VkBuffer buffers[] = { frame.instanceBuffer };
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 1, 1, buffers, offsets);
+
+			uint32_t runStart = firstDraw;
+			for (uint32_t i = firstDraw + 1; i <= firstDraw + count; i++)
+			{
+				if (i == firstDraw + count || (splitMaterials && _draws[i].material != _draws[runStart].material))
+				{
+					vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, stride * runStart, i - runStart, stride);
+					runStart = i;
+				}
+			}
+			return;
+		}
+
+		for (uint32_t i = firstDraw; i < firstDraw + count; i++)
+		{
+			VkBuffer buffers[] = { frame.instanceBuffer };
+			VkDeviceSize offsets[] = { 0 };
+			if (!_renderDevice.enabledFeatures.drawIndirectFirstInstance)
+			{
+				offsets[0] = sizeof(SorpModel::InstanceData) * _draws[i].instanceBase;
+			}
+			if (i == firstDraw || offsets[0] != 0)
+			{
+				vkCmdBindVertexBuffers(commandBuffer, 1, 1, buffers, offsets);
+			}
+
+			vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, stride * i, 1, stride);
+		}
+	}
+
+	void SorpGpuCuller::createDescriptorSetLayout()
+	{
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		for (uint32_t i = 0; i < bindings.size(); i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			bindings[i].pImmutableSamplers = nullptr;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(_renderDevice.device(), &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor set layout!");
+		}
+	}
+
+	void SorpGpuCuller::createPipelineLayout()
+	{
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullConstants);
+
+		VkPipelineLayoutCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineInfo.setLayoutCount = 1;
+		pipelineInfo.pSetLayouts = &_descriptorSetLayout;
+		pipelineInfo.pushConstantRangeCount = 1;
+		pipelineInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(_renderDevice.device(), &pipelineInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Couldnt create pipeline layout");
+		}
+	}
+
+	void SorpGpuCuller::createFrameResources(uint32_t frameCount)
+	{
+		_frames.resize(frameCount);
+		for (auto& frame : _frames)
+		{
+			_renderDevice.createBuffer(sizeof(ObjectData) * _maxObjects,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				frame.objectBuffer, frame.objectAllocation);
+
+			_renderDevice.createBuffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAWS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				frame.indirectBuffer, frame.indirectAllocation);
+
+			_renderDevice.createBuffer(sizeof(SorpModel::InstanceData) * _maxObjects,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				frame.instanceBuffer, frame.instanceAllocation);
+		}
+	}
+
+	void SorpGpuCuller::createDescriptorSets()
+	{
+		uint32_t frameCount = static_cast<uint32_t>(_frames.size());
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = 3 * frameCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = frameCount;
+
+		if (vkCreateDescriptorPool(_renderDevice.device(), &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(frameCount, _descriptorSetLayout);
+		std::vector<VkDescriptorSet> sets(frameCount);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = _descriptorPool;
+		allocInfo.descriptorSetCount = frameCount;
+		allocInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(_renderDevice.device(), &allocInfo, sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate descriptor sets!");
+		}
+
+		for (uint32_t i = 0; i < frameCount; i++)
+		{
+			FrameResources& frame = _frames[i];
+			frame.descriptorSet = sets[i];
+
+			std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+			bufferInfos[0].buffer = frame.objectBuffer;
+			bufferInfos[1].buffer = frame.indirectBuffer;
+			bufferInfos[2].buffer = frame.instanceBuffer;
+
+			std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+			for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++)
+			{
+				bufferInfos[binding].offset = 0;
+				bufferInfos[binding].range = VK_WHOLE_SIZE;
+
+				descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[binding].dstSet = frame.descriptorSet;
+				descriptorWrites[binding].dstBinding = binding;
+				descriptorWrites[binding].dstArrayElement = 0;
+				descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[binding].descriptorCount = 1;
+				descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+			}
+
+			vkUpdateDescriptorSets(_renderDevice.device(), static_cast<uint32_t>(descriptorWrites.size()),
+				descriptorWrites.data(), 0, nullptr);
+		}
+	}
+
+	bool SorpGpuCuller::supportsMultiDrawIndirect(uint32_t count) const
+	{
+		return _renderDevice.enabledFeatures.multiDrawIndirect && _renderDevice.enabledFeatures.drawIndirectFirstInstance &&
+			count <= _renderDevice.properties.limits.maxDrawIndirectCount;
+	}
+}
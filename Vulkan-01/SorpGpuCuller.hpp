@@ -0,0 +1,109 @@
+#pragma once
+
+#include "SorpComputePipeline.hpp"
+#include "SorpModel.hpp"
+#include "SorpFrameContext.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	// Frustum culls objects on the GPU and writes the surviving instances and their VkDrawIndexedIndirectCommand
+	// records, so the CPU cost of a frame no longer depends on how many objects are visible.
+	// Every draw owns a fixed slot in the indirect buffer and a fixed range of the output instance buffer.
+	class SorpGpuCuller
+	{
+	public:
+		// Matches ObjectData in cull.comp (std430)
+		struct ObjectData
+		{
+			SorpModel::InstanceData instance;
+			glm::vec4 boundingSphere;	// world space center and radius
+			uint32_t drawIndex;
+			uint32_t instanceBase;		// filled in by writeObjects
+			uint32_t maxInstances;		// filled in by writeObjects
+			uint32_t _padding;
+		};
+
+		static constexpr uint32_t MAX_DRAWS = 1024;
+		static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+		SorpGpuCuller(SorpRenderDevice& renderDevice, const std::string& cullShader, uint32_t maxObjects,
+			uint32_t frameCount = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT);
+		~SorpGpuCuller();
+
+		SorpGpuCuller(const SorpGpuCuller&) = delete;
+		SorpGpuCuller& operator=(const SorpGpuCuller&) = delete;
+
+		// Reserves a draw slot able to hold maxInstances visible instances of the model. Must not be called while frames are in flight.
+		uint32_t addDraw(const SorpModel& model, uint32_t maxInstances);
+		// Takes effect from the next recorded cull, the model has to stay alive while frames recorded with it are in flight
+		void setDrawModel(uint32_t drawIndex, const SorpModel& model);
+		// Only used to split multi-draws where the material changes, see draw()
+		void setDrawMaterial(uint32_t drawIndex, uint32_t material);
+		// No draw may be referenced by more objects than the maxInstances it was added with
+		void writeObjects(uint32_t frameIndex, const std::vector<ObjectData>& objects);
+
+		// Recorded outside of the render pass
+		void cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection);
+		// Expects the geometry arena to be bound, binds the culled instances at binding 1.
+		// Draws slots [firstDraw, firstDraw + count) so the draw list can be split across secondary command buffers.
+		// splitMaterials issues one multi-draw per run of draws sharing a material, for shaders that need the material
+		// to be dynamically uniform.
+		void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t firstDraw, uint32_t count, bool splitMaterials);
+
+		uint32_t drawCount() const { return static_cast<uint32_t>(_draws.size()); }
+
+	private:
+		struct CullConstants
+		{
+			glm::vec4 frustumPlanes[6];
+			uint32_t objectCount;
+		};
+
+		struct Draw
+		{
+			uint32_t instanceBase;
+			uint32_t maxInstances;
+			uint32_t material;
+		};
+
+		struct FrameResources
+		{
+			VkBuffer objectBuffer;
+			SorpAllocation objectAllocation;
+			uint32_t objectCount = 0;
+
+			VkBuffer indirectBuffer;
+			SorpAllocation indirectAllocation;
+			VkBuffer instanceBuffer;
+			SorpAllocation instanceAllocation;
+
+			VkDescriptorSet descriptorSet;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		uint32_t _maxObjects;
+
+		VkDescriptorSetLayout _descriptorSetLayout;
+		VkPipelineLayout _pipelineLayout;
+		VkDescriptorPool _descriptorPool;
+		std::unique_ptr<SorpComputePipeline> _cullPipeline;
+
+		// Draw commands with instanceCount = 0, written over the frame's indirect buffer before every cull
+		std::vector<VkDrawIndexedIndirectCommand> _commands;
+		std::vector<Draw> _draws;
+		uint32_t _reservedInstances = 0;
+
+		std::vector<FrameResources> _frames;
+
+		void createDescriptorSetLayout();
+		void createPipelineLayout();
+		void createFrameResources(uint32_t frameCount);
+		void createDescriptorSets();
+
+		bool supportsMultiDrawIndirect(uint32_t count) const;
+	};
+}
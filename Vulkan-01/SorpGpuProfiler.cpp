@@ -0,0 +1,217 @@
+#include "SorpGpuProfiler.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpGpuProfiler::SorpGpuProfiler(SorpRenderDevice& renderDevice, uint32_t frameCount, bool pipelineStatistics) :
+		_renderDevice{renderDevice}
+	{
+		uint32_t validBits = renderDevice.timestampValidBits;
+		_enabled = validBits != 0;
+		_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		// Top level scopes usually wrap vkCmdExecuteCommands, which needs inherited queries
+		if (pipelineStatistics && renderDevice.enabledFeatures.pipelineStatisticsQuery &&
+			renderDevice.enabledFeatures.inheritedQueries)
+		{
+			_statisticsFlags = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+		}
+
+		if (_enabled)
+		{
+			createQueryPools(frameCount);
+		}
+	}
+
+	SorpGpuProfiler::~SorpGpuProfiler()
+	{
+		VkDevice device = _renderDevice.device();
+		for (auto& frame : _frames)
+		{
+			VkQueryPool timestampPool = frame.timestampPool;
+			VkQueryPool statisticsPool = frame.statisticsPool;
+			_renderDevice.deferDestroy([device, timestampPool, statisticsPool]()
+			{
+				vkDestroyQueryPool(device, timestampPool, nullptr);
+				if (statisticsPool != VK_NULL_HANDLE)
+				{
+					vkDestroyQueryPool(device, statisticsPool, nullptr);
+				}
+			});
+		}
+	}
+
+	void SorpGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+	{
+		if (!_enabled)
+		{
+			return;
+		}
+
+		_currentFrame = frameIndex;
+		_freshResults = false;
+		_depth = 0;
+		_activeStatistics = INVALID_SCOPE;
+
+		FrameQueries& frame = _frames[frameIndex];
+		resolve(frame);
+
+		frame.scopes.clear();
+		frame.statisticsUsed = 0;
+		frame.cpuBeginNs = SorpCpuProfiler::nowNs();
+		vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, MAX_SCOPES * 2);
+		if (frame.statisticsPool != VK_NULL_HANDLE)
+		{
+			vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, MAX_SCOPES);
+		}
+	}
+
+	uint32_t SorpGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string& name)
+	{
+		if (!_enabled)
+		{
+			return INVALID_SCOPE;
+		}
+
+		FrameQueries& frame = _frames[_currentFrame];
+		if (frame.scopes.size() >= MAX_SCOPES)
+		{
+			throw std::runtime_error("too many gpu profiler scopes in one frame!");
+		}
+
+		uint32_t scope = static_cast<uint32_t>(frame.scopes.size());
+		// Queries of one type can't nest, so statistics stay with the outermost scope
+		bool hasStatistics = frame.statisticsPool != VK_NULL_HANDLE && _activeStatistics == INVALID_SCOPE;
+		frame.scopes.push_back({ name, _depth++, hasStatistics });
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, scope * 2);
+		if (hasStatistics)
+		{
+			vkCmdBeginQuery(commandBuffer, frame.statisticsPool, frame.statisticsUsed, 0);
+			_activeStatistics = scope;
+		}
+		return scope;
+	}
+
+	void SorpGpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (scope == INVALID_SCOPE)
+		{
+			return;
+		}
+
+		FrameQueries& frame = _frames[_currentFrame];
+		if (_activeStatistics == scope)
+		{
+			vkCmdEndQuery(commandBuffer, frame.statisticsPool, frame.statisticsUsed++);
+			_activeStatistics = INVALID_SCOPE;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool, scope * 2 + 1);
+		_depth--;
+	}
+
+	void SorpGpuProfiler::createQueryPools(uint32_t frameCount)
+	{
+		_frames.resize(frameCount);
+		for (auto& frame : _frames)
+		{
+			VkQueryPoolCreateInfo timestampInfo{};
+			timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			timestampInfo.queryCount = MAX_SCOPES * 2;
+
+			if (vkCreateQueryPool(_renderDevice.device(), &timestampInfo, nullptr, &frame.timestampPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create timestamp query pool!");
+			}
+
+			if (_statisticsFlags == 0)
+			{
+				continue;
+			}
+
+			VkQueryPoolCreateInfo statisticsInfo{};
+			statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			statisticsInfo.queryCount = MAX_SCOPES;
+			statisticsInfo.pipelineStatistics = _statisticsFlags;
+
+			if (vkCreateQueryPool(_renderDevice.device(), &statisticsInfo, nullptr, &frame.statisticsPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create pipeline statistics query pool!");
+			}
+		}
+	}
+
+	void SorpGpuProfiler::resolve(FrameQueries& frame)
+	{
+		if (frame.scopes.empty())
+		{
+			return;
+		}
+
+		uint32_t timestampCount = static_cast<uint32_t>(frame.scopes.size()) * 2;
+		std::vector<uint64_t> timestamps(timestampCount);
+		if (vkGetQueryPoolResults(_renderDevice.device(), frame.timestampPool, 0, timestampCount,
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		{
+			return;
+		}
+
+		std::vector<uint64_t> statistics(frame.statisticsUsed * STATISTIC_COUNT);
+		if (frame.statisticsUsed > 0 && vkGetQueryPoolResults(_renderDevice.device(), frame.statisticsPool, 0,
+			frame.statisticsUsed, statistics.size() * sizeof(uint64_t), statistics.data(),
+			STATISTIC_COUNT * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		{
+			return;
+		}
+
+		// timestampPeriod is nanoseconds per tick
+		double msPerTick = _renderDevice.properties.limits.timestampPeriod / 1000000.0;
+		uint64_t frameBegin = ~0ull;
+		uint64_t frameEnd = 0;
+		uint32_t statisticsIndex = 0;
+
+		_results.clear();
+		for (size_t i = 0; i < frame.scopes.size(); i++)
+		{
+			uint64_t begin = timestamps[i * 2] & _timestampMask;
+			uint64_t end = timestamps[i * 2 + 1] & _timestampMask;
+			frameBegin = std::min(frameBegin, begin);
+			frameEnd = std::max(frameEnd, end);
+
+			ScopeResult result{};
+			result.name = frame.scopes[i].name;
+			result.depth = frame.scopes[i].depth;
+			result.gpuMs = end > begin ? (end - begin) * msPerTick : 0.0;
+			result.hasStatistics = frame.scopes[i].hasStatistics;
+			if (result.hasStatistics)
+			{
+				std::copy_n(statistics.begin() + statisticsIndex * STATISTIC_COUNT, STATISTIC_COUNT, result.statistics.begin());
+				statisticsIndex++;
+			}
+			_results.push_back(result);
+		}
+
+		// Without calibrated timestamps the GPU clock is only placed relative to the start of recording, the
+		// real execution begins somewhat later
+		for (size_t i = 0; i < frame.scopes.size(); i++)
+		{
+			uint64_t begin = (timestamps[i * 2] & _timestampMask) - frameBegin;
+			uint64_t end = (timestamps[i * 2 + 1] & _timestampMask) - frameBegin;
+			SorpCpuProfiler::recordGpu(frame.scopes[i].name,
+				frame.cpuBeginNs + static_cast<uint64_t>(begin * _renderDevice.properties.limits.timestampPeriod),
+				frame.cpuBeginNs + static_cast<uint64_t>(std::max(begin, end) * _renderDevice.properties.limits.timestampPeriod));
+		}
+		_frameGpuMs = frameEnd > frameBegin ? (frameEnd - frameBegin) * msPerTick : 0.0;
+		_freshResults = true;
+	}
+}
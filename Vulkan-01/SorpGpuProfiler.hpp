@@ -0,0 +1,122 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpFrameContext.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	// Times named scopes of a frame's command buffer with timestamp queries, optionally collecting pipeline
+	// statistics for top level scopes. Every frame in flight owns its query pools, results are read back once
+	// the frame comes around again, so reading never stalls on the GPU.
+	class SorpGpuProfiler
+	{
+	public:
+		enum Statistic
+		{
+			INPUT_VERTICES,
+			INPUT_PRIMITIVES,
+			VERTEX_INVOCATIONS,
+			CLIPPING_PRIMITIVES,
+			FRAGMENT_INVOCATIONS,
+			COMPUTE_INVOCATIONS,
+			STATISTIC_COUNT
+		};
+
+		struct ScopeResult
+		{
+			std::string name;
+			uint32_t depth;
+			double gpuMs;
+			bool hasStatistics;
+			std::array<uint64_t, STATISTIC_COUNT> statistics;
+		};
+
+		static constexpr uint32_t MAX_SCOPES = 32;
+		static constexpr uint32_t INVALID_SCOPE = ~0u;
+
+		SorpGpuProfiler(SorpRenderDevice& renderDevice, uint32_t frameCount = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT,
+			bool pipelineStatistics = false);
+		~SorpGpuProfiler();
+
+		SorpGpuProfiler(const SorpGpuProfiler&) = delete;
+		SorpGpuProfiler& operator=(const SorpGpuProfiler&) = delete;
+
+		// Record first thing into the frame's command buffer, after its fence was waited on. Reads back what the
+		// frame recorded last time around and resets its queries.
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+		// Scopes nest and have to be closed in reverse order. A top level scope that executes secondary command
+		// buffers needs statisticsFlags() in their inheritance info.
+		uint32_t beginScope(VkCommandBuffer commandBuffer, const std::string& name);
+		void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		// Scopes of the most recently resolved frame
+		const std::vector<ScopeResult>& results() const { return _results; }
+		// From the first timestamp to the last of the most recently resolved frame
+		double frameGpuMs() const { return _frameGpuMs; }
+		// False when the last beginFrame had nothing to read back or the read failed, results() and frameGpuMs()
+		// then still hold an earlier frame
+		bool hasFreshResults() const { return _freshResults; }
+
+		bool isEnabled() const { return _enabled; }
+		VkQueryPipelineStatisticFlags statisticsFlags() const { return _statisticsFlags; }
+
+	private:
+		struct Scope
+		{
+			std::string name;
+			uint32_t depth;
+			bool hasStatistics;
+		};
+
+		struct FrameQueries
+		{
+			VkQueryPool timestampPool = VK_NULL_HANDLE;
+			VkQueryPool statisticsPool = VK_NULL_HANDLE;
+			std::vector<Scope> scopes;
+			uint32_t statisticsUsed = 0;
+			// CPU time recording started, anchors the frame on the GPU track of a CPU trace
+			uint64_t cpuBeginNs = 0;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		bool _enabled;
+		VkQueryPipelineStatisticFlags _statisticsFlags = 0;
+		uint64_t _timestampMask;
+
+		std::vector<FrameQueries> _frames;
+		uint32_t _currentFrame = 0;
+		uint32_t _depth = 0;
+		uint32_t _activeStatistics = INVALID_SCOPE;
+
+		std::vector<ScopeResult> _results;
+		double _frameGpuMs = 0.0;
+		bool _freshResults = false;
+
+		void createQueryPools(uint32_t frameCount);
+		void resolve(FrameQueries& frame);
+	};
+
+	// Closes the scope when it goes out of scope
+	class SorpGpuScope
+	{
+	public:
+		SorpGpuScope(SorpGpuProfiler& profiler, VkCommandBuffer commandBuffer, const std::string& name) :
+			_profiler{profiler}, _commandBuffer{commandBuffer}, _scope{profiler.beginScope(commandBuffer, name)}
+		{
+		}
+		~SorpGpuScope() { _profiler.endScope(_commandBuffer, _scope); }
+
+		SorpGpuScope(const SorpGpuScope&) = delete;
+		SorpGpuScope& operator=(const SorpGpuScope&) = delete;
+
+	private:
+		SorpGpuProfiler& _profiler;
+		VkCommandBuffer _commandBuffer;
+		uint32_t _scope;
+	};
+}
@@ -0,0 +1,298 @@
+#include "SorpJobSystem.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <algorithm>
+
+namespace sorp_v
+{
+	namespace
+	{
+		thread_local const SorpJobSystem* t_jobSystem = nullptr;
+		thread_local uint32_t t_threadIndex = 0;
+	}
+
+	SorpJobSystem::SorpJobSystem(uint32_t workerCount)
+	{
+		// Deque 0 belongs to external threads and is never pushed to, it keeps the indices aligned
+		for (uint32_t i = 0; i <= workerCount; i++)
+		{
+			_deques.push_back(std::make_unique<WorkStealingDeque>());
+		}
+
+		for (uint32_t i = 1; i <= workerCount; i++)
+		{
+			_workers.emplace_back(&SorpJobSystem::workerLoop, this, i);
+		}
+	}
+
+	SorpJobSystem::~SorpJobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+			_stop.store(true);
+		}
+		_wakeCondition.notify_all();
+
+		for (auto& worker : _workers)
+		{
+			worker.join();
+		}
+
+		for (auto* job : _injectionQueue)
+		{
+			delete job;
+		}
+	}
+
+	void SorpJobSystem::run(std::function<void()> function, SorpJobCounter* counter)
+	{
+		if (counter)
+		{
+			counter->_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		schedule(new SorpJob{ std::move(function), counter });
+	}
+
+	void SorpJobSystem::runAfter(SorpJobCounter& dependency, std::function<void()> function, SorpJobCounter* counter)
+	{
+		if (counter)
+		{
+			counter->_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		auto* job = new SorpJob{ std::move(function), counter };
+		{
+			// Only pending counts here: finish() drains the list under this mutex once pending reached zero, while
+			// _finishing may still be set after that drain and would strand the job
+			std::lock_guard<std::mutex> lock(dependency._mutex);
+			if (dependency._pending.load() != 0)
+			{
+				dependency._continuations.push_back(job);
+				return;
+			}
+		}
+		schedule(job);
+	}
+
+	void SorpJobSystem::wait(SorpJobCounter& counter)
+	{
+		uint32_t index = threadIndex();
+		while (!counter.isDone())
+		{
+			if (SorpJob* job = findJob(index))
+			{
+				execute(job);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void SorpJobSystem::parallelFor(uint32_t count, uint32_t grainSize, const RangeFunction& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		grainSize = std::max(grainSize, 1u);
+		if (count <= grainSize)
+		{
+			function(0, count);
+			return;
+		}
+
+		SorpJobCounter counter;
+		for (uint32_t first = grainSize; first < count; first += grainSize)
+		{
+			uint32_t rangeCount = std::min(grainSize, count - first);
+			run([&function, first, rangeCount] { function(first, rangeCount); }, &counter);
+		}
+
+		// The first range runs on the calling thread
+		function(0, grainSize);
+		wait(counter);
+	}
+
+	uint32_t SorpJobSystem::threadIndex() const
+	{
+		return t_jobSystem == this ? t_threadIndex : 0;
+	}
+
+	uint32_t SorpJobSystem::defaultWorkerCount()
+	{
+		uint32_t cores = std::thread::hardware_concurrency();
+		return cores > 1 ? cores - 1 : 1;
+	}
+
+	void SorpJobSystem::workerLoop(uint32_t threadIndex)
+	{
+		t_jobSystem = this;
+		t_threadIndex = threadIndex;
+		SorpCpuProfiler::setThreadName("worker " + std::to_string(threadIndex));
+
+		while (true)
+		{
+			if (SorpJob* job = findJob(threadIndex))
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(_sleepMutex);
+			_sleepingWorkers.fetch_add(1);
+			_wakeCondition.wait(lock, [&] { return _stop.load() || _queuedJobs.load() > 0; });
+			_sleepingWorkers.fetch_sub(1);
+
+			if (_stop.load())
+			{
+				return;
+			}
+		}
+	}
+
+	void SorpJobSystem::schedule(SorpJob* job)
+	{
+		_queuedJobs.fetch_add(1);
+
+		uint32_t index = threadIndex();
+		if (index == 0 || !_deques[index]->push(job))
+		{
+			std::lock_guard<std::mutex> lock(_injectionMutex);
+			_injectionQueue.push_back(job);
+		}
+
+		if (_sleepingWorkers.load() > 0)
+		{
+			// Taking the lock orders the notify after a worker's predicate check, so the wake up can't be lost
+			std::lock_guard<std::mutex> lock(_sleepMutex);
+			_wakeCondition.notify_one();
+		}
+	}
+
+	SorpJob* SorpJobSystem::findJob(uint32_t threadIndex)
+	{
+		SorpJob* job = nullptr;
+		if (threadIndex != 0)
+		{
+			job = _deques[threadIndex]->pop();
+		}
+
+		if (!job)
+		{
+			std::lock_guard<std::mutex> lock(_injectionMutex);
+			if (!_injectionQueue.empty())
+			{
+				job = _injectionQueue.front();
+				_injectionQueue.pop_front();
+			}
+		}
+
+		// Steal starting from the next worker so victims are spread out
+		for (uint32_t i = 1; !job && i < _deques.size(); i++)
+		{
+			uint32_t victim = (threadIndex + i) % static_cast<uint32_t>(_deques.size());
+			if (victim != 0)
+			{
+				job = _deques[victim]->steal();
+			}
+		}
+
+		if (job)
+		{
+			_queuedJobs.fetch_sub(1);
+		}
+		return job;
+	}
+
+	void SorpJobSystem::execute(SorpJob* job)
+	{
+		job->function();
+		if (job->counter)
+		{
+			finish(job->counter);
+		}
+		delete job;
+	}
+
+	void SorpJobSystem::finish(SorpJobCounter* counter)
+	{
+		std::vector<SorpJob*> continuations;
+
+		counter->_finishing.fetch_add(1);
+		if (counter->_pending.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> lock(counter->_mutex);
+			continuations.swap(counter->_continuations);
+		}
+		counter->_finishing.fetch_sub(1);
+
+		for (auto* continuation : continuations)
+		{
+			schedule(continuation);
+		}
+	}
+
+	bool SorpJobSystem::WorkStealingDeque::push(SorpJob* job)
+	{
+		int64_t bottom = _bottom.load(std::memory_order_relaxed);
+		int64_t top = _top.load(std::memory_order_acquire);
+		if (bottom - top >= CAPACITY)
+		{
+			return false;
+		}
+
+		_buffer[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	SorpJob* SorpJobSystem::WorkStealingDeque::pop()
+	{
+		int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+		_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = _top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		SorpJob* job = _buffer[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			// Last job, race the thieves for it
+			if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				job = nullptr;
+			}
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	SorpJob* SorpJobSystem::WorkStealingDeque::steal()
+	{
+		int64_t top = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = _bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		SorpJob* job = _buffer[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+		if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+		return job;
+	}
+}
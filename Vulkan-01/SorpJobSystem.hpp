@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sorp_v
+{
+	class SorpJobSystem;
+	struct SorpJob;
+
+	// Counts unfinished jobs. Continuations registered with runAfter are scheduled when it drops to zero.
+	class SorpJobCounter
+	{
+	public:
+		SorpJobCounter() = default;
+		SorpJobCounter(const SorpJobCounter&) = delete;
+		SorpJobCounter& operator=(const SorpJobCounter&) = delete;
+
+		bool isDone() const { return _pending.load() == 0 && _finishing.load() == 0; }
+
+	private:
+		friend class SorpJobSystem;
+
+		std::atomic<uint32_t> _pending{0};
+		// Threads still touching the counter after their decrement, the owner may destroy it once this drops to zero
+		std::atomic<uint32_t> _finishing{0};
+		std::mutex _mutex;
+		std::vector<SorpJob*> _continuations;
+	};
+
+	struct SorpJob
+	{
+		std::function<void()> function;
+		SorpJobCounter* counter = nullptr;
+	};
+
+	// Work stealing scheduler with one worker per core. Workers push to and pop from their own Chase-Lev deque
+	// and steal from the others when it runs dry; threads outside the system submit through a shared injection queue.
+	// Jobs must not throw.
+	class SorpJobSystem
+	{
+	public:
+		using RangeFunction = std::function<void(uint32_t first, uint32_t count)>;
+
+		// The thread that waits on counters helps executing jobs, so one core is left for it by default
+		explicit SorpJobSystem(uint32_t workerCount = defaultWorkerCount());
+		~SorpJobSystem();
+
+		SorpJobSystem(const SorpJobSystem&) = delete;
+		SorpJobSystem& operator=(const SorpJobSystem&) = delete;
+
+		void run(std::function<void()> function, SorpJobCounter* counter = nullptr);
+		// Scheduled once dependency reaches zero, counter is incremented right away
+		void runAfter(SorpJobCounter& dependency, std::function<void()> function, SorpJobCounter* counter = nullptr);
+		// Executes other jobs on the calling thread until the counter reaches zero
+		void wait(SorpJobCounter& counter);
+
+		// Splits [0, count) into ranges of at most grainSize and blocks until all of them ran
+		void parallelFor(uint32_t count, uint32_t grainSize, const RangeFunction& function);
+
+		uint32_t workerCount() const { return static_cast<uint32_t>(_workers.size()); }
+		// 1..workerCount() on worker threads, 0 on any other thread
+		uint32_t threadIndex() const;
+		uint32_t threadCount() const { return workerCount() + 1; }
+
+		static uint32_t defaultWorkerCount();
+
+	private:
+		// Chase-Lev deque (Le et al. 2013, "Correct and Efficient Work-Stealing for Weak Memory Models")
+		class WorkStealingDeque
+		{
+		public:
+			static constexpr int64_t CAPACITY = 4096;
+
+			bool push(SorpJob* job);
+			SorpJob* pop();
+			SorpJob* steal();
+
+		private:
+			alignas(64) std::atomic<int64_t> _top{0};
+			alignas(64) std::atomic<int64_t> _bottom{0};
+			std::atomic<SorpJob*> _buffer[CAPACITY];
+		};
+
+		std::vector<std::thread> _workers;
+		std::vector<std::unique_ptr<WorkStealingDeque>> _deques;
+
+		std::mutex _injectionMutex;
+		std::deque<SorpJob*> _injectionQueue;
+
+		std::mutex _sleepMutex;
+		std::condition_variable _wakeCondition;
+		std::atomic<uint32_t> _sleepingWorkers{0};
+		std::atomic<int64_t> _queuedJobs{0};
+		std::atomic<bool> _stop{false};
+
+		void workerLoop(uint32_t threadIndex);
+		void schedule(SorpJob* job);
+		SorpJob* findJob(uint32_t threadIndex);
+		void execute(SorpJob* job);
+		void finish(SorpJobCounter* counter);
+	};
+}
@@ -0,0 +1,244 @@
+#include "SorpKtx2.hpp"
+#include "SorpMipGenerator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	namespace
+	{
+		const uint8_t IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+		constexpr size_t HEADER_SIZE = 80;
+		constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+		// Khronos Data Format values for BC1 and BC3 blocks
+		constexpr uint8_t KHR_DF_MODEL_BC1A = 128;
+		constexpr uint8_t KHR_DF_MODEL_BC3 = 130;
+		constexpr uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+		constexpr uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+		constexpr uint8_t KHR_DF_TRANSFER_SRGB = 2;
+		constexpr uint8_t KHR_DF_CHANNEL_BC1A_COLOR = 0;
+		constexpr uint8_t KHR_DF_CHANNEL_BC1A_ALPHAPRESENT = 1;
+		constexpr uint8_t KHR_DF_CHANNEL_BC3_COLOR = 0;
+		constexpr uint8_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+		// Qualifier in the channel type byte, alpha stays linear in sRGB formats
+		constexpr uint8_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+		constexpr uint16_t KHR_DF_VERSION = 2;
+
+		template<typename T>
+		T read(const std::vector<uint8_t>& data, size_t offset)
+		{
+			T value;
+			memcpy(&value, data.data() + offset, sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		void append(std::vector<uint8_t>& out, T value)
+		{
+			size_t offset = out.size();
+			out.resize(offset + sizeof(T));
+			memcpy(out.data() + offset, &value, sizeof(T));
+		}
+
+		template<typename T>
+		void patch(std::vector<uint8_t>& out, size_t offset, T value)
+		{
+			memcpy(out.data() + offset, &value, sizeof(T));
+		}
+	}
+
+	SorpKtx2::Texture SorpKtx2::load(const std::string& path)
+	{
+		std::ifstream file{ path, std::ios::binary };
+		if (!file)
+		{
+			throw std::runtime_error("failed to open ktx2 file: " + path);
+		}
+
+		Texture texture{};
+		texture.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		const std::vector<uint8_t>& data = texture.data;
+
+		if (data.size() < HEADER_SIZE || memcmp(data.data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+		{
+			throw std::runtime_error("not a ktx2 file: " + path);
+		}
+
+		texture.format = static_cast<VkFormat>(read<uint32_t>(data, 12));
+		texture.width = read<uint32_t>(data, 20);
+		texture.height = read<uint32_t>(data, 24);
+		uint32_t depth = read<uint32_t>(data, 28);
+		uint32_t layerCount = read<uint32_t>(data, 32);
+		uint32_t faceCount = read<uint32_t>(data, 36);
+		uint32_t levelCount = read<uint32_t>(data, 40);
+		uint32_t supercompression = read<uint32_t>(data, 44);
+
+		// A level count of 0 asks the loader to generate mips, cooked files always carry them
+		if (depth > 1 || layerCount > 1 || faceCount != 1 || levelCount == 0 || supercompression != 0 ||
+			texture.width == 0 || texture.height == 0 ||
+			levelCount > SorpMipGenerator::mipLevelCount(texture.width, texture.height))
+		{
+			throw std::runtime_error("unsupported ktx2 layout: " + path);
+		}
+
+		// The uploader copies levels as tightly packed blocks of this size
+		uint32_t block = blockSize(texture.format);
+		if (block == 0)
+		{
+			throw std::runtime_error("unsupported ktx2 format: " + path);
+		}
+
+		if (data.size() < HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE)
+		{
+			throw std::runtime_error("truncated ktx2 level index: " + path);
+		}
+
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			size_t entry = HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+			uint64_t byteOffset = read<uint64_t>(data, entry);
+			uint64_t byteLength = read<uint64_t>(data, entry + 8);
+			if (byteOffset > data.size() || byteLength > data.size() - byteOffset)
+			{
+				throw std::runtime_error("truncated ktx2 level data: " + path);
+			}
+
+			Level info{};
+			info.offset = static_cast<size_t>(byteOffset);
+			info.size = static_cast<size_t>(byteLength);
+			info.width = std::max(texture.width >> level, 1u);
+			info.height = std::max(texture.height >> level, 1u);
+
+			uint64_t blocksWide = (static_cast<uint64_t>(info.width) + 3) / 4;
+			uint64_t blocksHigh = (static_cast<uint64_t>(info.height) + 3) / 4;
+			if (byteLength != blocksWide * blocksHigh * block)
+			{
+				throw std::runtime_error("ktx2 level size doesn't match its dimensions: " + path);
+			}
+			texture.levels.push_back(info);
+		}
+		return texture;
+	}
+
+	void SorpKtx2::write(const std::string& path, const Texture& texture)
+	{
+		uint32_t block = blockSize(texture.format);
+		if (block == 0)
+		{
+			throw std::runtime_error("ktx2 writer doesn't support this format!");
+		}
+
+		std::vector<uint8_t> out(IDENTIFIER, IDENTIFIER + sizeof(IDENTIFIER));
+		append<uint32_t>(out, texture.format);
+		append<uint32_t>(out, 1);	// typeSize, 1 for block compressed formats
+		append<uint32_t>(out, texture.width);
+		append<uint32_t>(out, texture.height);
+		append<uint32_t>(out, 0);	// pixelDepth
+		append<uint32_t>(out, 0);	// layerCount
+		append<uint32_t>(out, 1);	// faceCount
+		append<uint32_t>(out, static_cast<uint32_t>(texture.levels.size()));
+		append<uint32_t>(out, 0);	// supercompressionScheme
+
+		// Index, offsets are patched in once known
+		size_t indexOffset = out.size();
+		out.resize(HEADER_SIZE + texture.levels.size() * LEVEL_INDEX_ENTRY_SIZE, 0);
+
+		size_t dfdOffset = out.size();
+		writeDescriptor(out, texture.format);
+		patch<uint32_t>(out, indexOffset, static_cast<uint32_t>(dfdOffset));
+		patch<uint32_t>(out, indexOffset + 4, static_cast<uint32_t>(out.size() - dfdOffset));
+
+		// Smallest level first as the spec asks, each aligned to lcm(block size, 4)
+		size_t alignment = std::max<size_t>(block, 4);
+		for (size_t level = texture.levels.size(); level-- > 0;)
+		{
+			const Level& source = texture.levels[level];
+			out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+
+			size_t entry = HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+			patch<uint64_t>(out, entry, out.size());
+			patch<uint64_t>(out, entry + 8, source.size);
+			patch<uint64_t>(out, entry + 16, source.size);
+
+			out.insert(out.end(), texture.data.begin() + source.offset, texture.data.begin() + source.offset + source.size);
+		}
+
+		std::ofstream file{ path, std::ios::binary };
+		if (!file.write(reinterpret_cast<const char*>(out.data()), out.size()))
+		{
+			throw std::runtime_error("failed to write ktx2 file: " + path);
+		}
+	}
+
+	uint32_t SorpKtx2::blockSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			return 8;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	void SorpKtx2::writeDescriptor(std::vector<uint8_t>& out, VkFormat format)
+	{
+		bool bc3 = format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK;
+		bool srgb = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+			format == VK_FORMAT_BC3_SRGB_BLOCK;
+		bool alpha = format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+
+		// One basic descriptor block. BC1 has a single sample covering the whole 64 bit block, BC3 one for the
+		// alpha half followed by one for the color half.
+		const uint16_t sampleCount = bc3 ? 2 : 1;
+		const uint16_t blockSize = 24 + 16 * sampleCount;
+		append<uint32_t>(out, 4 + blockSize);	// dfdTotalSize
+		append<uint32_t>(out, 0);				// vendorId and descriptorType, both KHR basic
+		append<uint16_t>(out, KHR_DF_VERSION);
+		append<uint16_t>(out, blockSize);
+		append<uint8_t>(out, bc3 ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A);
+		append<uint8_t>(out, KHR_DF_PRIMARIES_BT709);
+		append<uint8_t>(out, srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR);
+		append<uint8_t>(out, 0);				// flags, straight alpha
+		// Texel block dimensions minus one: 4x4x1x1
+		append<uint8_t>(out, 3);
+		append<uint8_t>(out, 3);
+		append<uint8_t>(out, 0);
+		append<uint8_t>(out, 0);
+		// bytesPlane0..7
+		append<uint8_t>(out, static_cast<uint8_t>(SorpKtx2::blockSize(format)));
+		out.resize(out.size() + 7, 0);
+
+		auto appendSample = [&](uint16_t bitOffset, uint8_t channelType)
+		{
+			append<uint16_t>(out, bitOffset);
+			append<uint8_t>(out, 63);			// bitLength minus one
+			append<uint8_t>(out, channelType);
+			append<uint32_t>(out, 0);			// samplePosition0..3
+			append<uint32_t>(out, 0);			// sampleLower
+			append<uint32_t>(out, ~0u);			// sampleUpper
+		};
+
+		if (bc3)
+		{
+			appendSample(0, KHR_DF_CHANNEL_BC3_ALPHA | (srgb ? KHR_DF_SAMPLE_DATATYPE_LINEAR : 0));
+			appendSample(64, KHR_DF_CHANNEL_BC3_COLOR);
+		}
+		else
+		{
+			appendSample(0, alpha ? KHR_DF_CHANNEL_BC1A_ALPHAPRESENT : KHR_DF_CHANNEL_BC1A_COLOR);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	// Reads and writes the subset of KTX2 the engine produces: a single 2D image with a mip chain, no array layers,
+	// cube faces or supercompression. The level data stays in the format the GPU consumes.
+	class SorpKtx2
+	{
+	public:
+		struct Level
+		{
+			// Into data
+			size_t offset;
+			size_t size;
+			uint32_t width;
+			uint32_t height;
+		};
+
+		struct Texture
+		{
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			// Level 0 first
+			std::vector<Level> levels;
+			std::vector<uint8_t> data;
+		};
+
+		static Texture load(const std::string& path);
+		// Only the BC1 and BC3 formats the cooker produces have a data format descriptor here
+		static void write(const std::string& path, const Texture& texture);
+
+		// Bytes of one 4x4 block, 0 for formats the engine doesn't cook to
+		static uint32_t blockSize(VkFormat format);
+
+	private:
+		static void writeDescriptor(std::vector<uint8_t>& out, VkFormat format);
+	};
+}
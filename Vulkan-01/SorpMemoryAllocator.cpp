@@ -0,0 +1,331 @@
+#include "SorpMemoryAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpMemoryAllocator::SorpMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize) :
+		_device{device}, _preferredBlockSize{preferredBlockSize}
+	{
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		_bufferImageGranularity = properties.limits.bufferImageGranularity;
+	}
+
+	SorpMemoryAllocator::~SorpMemoryAllocator()
+	{
+		assert(_stats.allocationCount == 0 && "Device memory leaked: not every allocation was freed");
+
+		for (auto& block : _blocks)
+		{
+			if (block)
+			{
+				vkFreeMemory(_device, block->memory, nullptr);
+			}
+		}
+	}
+
+	SorpAllocation SorpMemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		ResourceKind kind, bool preferDedicated)
+	{
+		uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+		VkDeviceSize blockBytes = blockSize(memoryTypeIndex);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (preferDedicated || requirements.size > blockBytes / 2 || requirements.alignment > blockBytes / 2)
+		{
+			return allocateDedicated(requirements.size, memoryTypeIndex);
+		}
+
+		// Buddy offsets are aligned to their own size, so rounding the size up covers the alignment as well
+		uint32_t order = orderForSize(std::max(requirements.size, requirements.alignment));
+		if (!separateResourceKinds())
+		{
+			kind = ResourceKind::Linear;
+		}
+
+		SorpAllocation allocation{};
+		for (uint32_t i = 0; i < _blocks.size(); i++)
+		{
+			auto& block = _blocks[i];
+			if (block && block->memoryTypeIndex == memoryTypeIndex && block->kind == kind && allocateFromBlock(i, order, allocation))
+			{
+				return allocation;
+			}
+		}
+
+		uint32_t blockId = createBlock(memoryTypeIndex, kind);
+		if (!allocateFromBlock(blockId, order, allocation))
+		{
+			throw std::runtime_error("failed to sub-allocate device memory from a fresh block!");
+		}
+		return allocation;
+	}
+
+	void SorpMemoryAllocator::free(SorpAllocation& allocation)
+	{
+		if (!allocation.isValid())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (allocation.isDedicated())
+		{
+			vkFreeMemory(_device, allocation.memory, nullptr);
+			_stats.dedicatedAllocationCount--;
+			_stats.bytesReserved -= allocation.size;
+			_stats.bytesUsed -= allocation.size;
+		}
+		else
+		{
+			freeFromBlock(allocation);
+		}
+
+		_stats.allocationCount--;
+		allocation = SorpAllocation{};
+	}
+
+	uint32_t SorpMemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) &&
+				(_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	VkDeviceSize SorpMemoryAllocator::blockSize(uint32_t memoryTypeIndex) const
+	{
+		uint32_t heapIndex = _memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+		VkDeviceSize heapSize = _memoryProperties.memoryHeaps[heapIndex].size;
+
+		// Small heaps (e.g. the 256MB host visible window into VRAM) get smaller blocks
+		VkDeviceSize size = _preferredBlockSize;
+		while (size > MIN_ALLOCATION_SIZE * 1024 && size > heapSize / 8)
+		{
+			size /= 2;
+		}
+		return size;
+	}
+
+	bool SorpMemoryAllocator::isUnifiedMemory() const
+	{
+		uint32_t largestHeap = UINT32_MAX;
+		for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; i++)
+		{
+			if ((_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+				(largestHeap == UINT32_MAX || _memoryProperties.memoryHeaps[i].size > _memoryProperties.memoryHeaps[largestHeap].size))
+			{
+				largestHeap = i;
+			}
+		}
+
+		VkMemoryPropertyFlags unified = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+		{
+			if (_memoryProperties.memoryTypes[i].heapIndex == largestHeap &&
+				(_memoryProperties.memoryTypes[i].propertyFlags & unified) == unified)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	SorpMemoryStats SorpMemoryAllocator::stats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+	VkDeviceMemory SorpMemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		_stats.deviceAllocationCalls++;
+
+		*mapped = nullptr;
+		if (_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+			{
+				vkFreeMemory(_device, memory, nullptr);
+				throw std::runtime_error("failed to map device memory!");
+			}
+		}
+
+		return memory;
+	}
+
+	SorpAllocation SorpMemoryAllocator::allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex)
+	{
+		SorpAllocation allocation{};
+		allocation.memory = allocateDeviceMemory(size, memoryTypeIndex, &allocation.mapped);
+		allocation.offset = 0;
+		allocation.size = size;
+		allocation.memoryTypeIndex = memoryTypeIndex;
+		allocation.blockId = SorpAllocation::DEDICATED_BLOCK;
+
+		_stats.dedicatedAllocationCount++;
+		_stats.allocationCount++;
+		_stats.allocateCalls++;
+		_stats.bytesReserved += size;
+		_stats.bytesUsed += size;
+		return allocation;
+	}
+
+	uint32_t SorpMemoryAllocator::createBlock(uint32_t memoryTypeIndex, ResourceKind kind)
+	{
+		auto block = std::make_unique<Block>();
+		block->size = blockSize(memoryTypeIndex);
+		block->memoryTypeIndex = memoryTypeIndex;
+		block->kind = kind;
+		block->maxOrder = orderForSize(block->size);
+		block->freeLists.resize(block->maxOrder + 1);
+		block->freeLists[block->maxOrder].insert(0);
+		block->memory = allocateDeviceMemory(block->size, memoryTypeIndex, &block->mapped);
+
+		_stats.blockCount++;
+		_stats.bytesReserved += block->size;
+
+		for (uint32_t i = 0; i < _blocks.size(); i++)
+		{
+			if (!_blocks[i])
+			{
+				_blocks[i] = std::move(block);
+				return i;
+			}
+		}
+
+		_blocks.push_back(std::move(block));
+		return static_cast<uint32_t>(_blocks.size() - 1);
+	}
+
+	bool SorpMemoryAllocator::allocateFromBlock(uint32_t blockId, uint32_t order, SorpAllocation& allocation)
+	{
+		Block& block = *_blocks[blockId];
+		if (order > block.maxOrder)
+		{
+			return false;
+		}
+
+		uint32_t current = order;
+		while (current <= block.maxOrder && block.freeLists[current].empty())
+		{
+			current++;
+		}
+		if (current > block.maxOrder)
+		{
+			return false;
+		}
+
+		VkDeviceSize offset = *block.freeLists[current].begin();
+		block.freeLists[current].erase(block.freeLists[current].begin());
+
+		// Split down to the requested order, returning the upper halves to the free lists
+		while (current > order)
+		{
+			current--;
+			block.freeLists[current].insert(offset + (MIN_ALLOCATION_SIZE << current));
+		}
+
+		VkDeviceSize size = MIN_ALLOCATION_SIZE << order;
+		block.usedBytes += size;
+		block.allocationCount++;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		allocation.memoryTypeIndex = block.memoryTypeIndex;
+		allocation.blockId = blockId;
+		allocation.order = order;
+
+		_stats.allocationCount++;
+		_stats.allocateCalls++;
+		_stats.bytesUsed += size;
+		return true;
+	}
+
+	void SorpMemoryAllocator::freeFromBlock(SorpAllocation& allocation)
+	{
+		Block& block = *_blocks[allocation.blockId];
+		VkDeviceSize offset = allocation.offset;
+		uint32_t order = allocation.order;
+
+		block.usedBytes -= allocation.size;
+		block.allocationCount--;
+		_stats.bytesUsed -= allocation.size;
+
+		// Merge with the buddy for as long as it is free
+		while (order < block.maxOrder)
+		{
+			VkDeviceSize buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+			auto it = block.freeLists[order].find(buddy);
+			if (it == block.freeLists[order].end())
+			{
+				break;
+			}
+
+			block.freeLists[order].erase(it);
+			offset = std::min(offset, buddy);
+			order++;
+		}
+		block.freeLists[order].insert(offset);
+
+		if (block.allocationCount == 0)
+		{
+			// Keep one empty block around per memory type to avoid thrashing vkAllocateMemory
+			for (uint32_t i = 0; i < _blocks.size(); i++)
+			{
+				if (i != allocation.blockId && _blocks[i] && _blocks[i]->memoryTypeIndex == block.memoryTypeIndex &&
+					_blocks[i]->kind == block.kind)
+				{
+					releaseBlock(allocation.blockId);
+					break;
+				}
+			}
+		}
+	}
+
+	void SorpMemoryAllocator::releaseBlock(uint32_t blockId)
+	{
+		auto& block = _blocks[blockId];
+		vkFreeMemory(_device, block->memory, nullptr);
+
+		_stats.blockCount--;
+		_stats.bytesReserved -= block->size;
+		block.reset();
+	}
+
+	uint32_t SorpMemoryAllocator::orderForSize(VkDeviceSize size)
+	{
+		uint32_t order = 0;
+		while ((MIN_ALLOCATION_SIZE << order) < size)
+		{
+			order++;
+		}
+		return order;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace sorp_v
+{
+	struct SorpAllocation
+	{
+		static constexpr uint32_t DEDICATED_BLOCK = UINT32_MAX;
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// Persistently mapped pointer to the start of the allocation, nullptr for non host visible memory
+		void* mapped = nullptr;
+
+		uint32_t memoryTypeIndex = 0;
+		uint32_t blockId = DEDICATED_BLOCK;
+		uint32_t order = 0;
+
+		bool isValid() const { return memory != VK_NULL_HANDLE; }
+		bool isDedicated() const { return blockId == DEDICATED_BLOCK; }
+	};
+
+	struct SorpMemoryStats
+	{
+		uint64_t blockCount = 0;
+		uint64_t dedicatedAllocationCount = 0;
+		uint64_t allocationCount = 0;
+		uint64_t bytesReserved = 0;
+		uint64_t bytesUsed = 0;
+		uint64_t deviceAllocationCalls = 0;
+		// Every allocate() so far, allocationCount only counts the live ones
+		uint64_t allocateCalls = 0;
+	};
+
+	// Sub-allocates device memory out of large per memory type blocks using a buddy allocator.
+	// Large resources get their own VkDeviceMemory so they don't fragment the blocks.
+	class SorpMemoryAllocator
+	{
+	public:
+		enum class ResourceKind
+		{
+			Linear,		// buffers and linear tiled images
+			Optimal		// optimal tiled images
+		};
+
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+		static constexpr VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+		SorpMemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+		~SorpMemoryAllocator();
+
+		SorpMemoryAllocator(const SorpMemoryAllocator&) = delete;
+		SorpMemoryAllocator& operator=(const SorpMemoryAllocator&) = delete;
+
+		SorpAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+			ResourceKind kind, bool preferDedicated = false);
+		void free(SorpAllocation& allocation);
+
+		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return _memoryProperties; }
+		VkDeviceSize blockSize(uint32_t memoryTypeIndex) const;
+		// True when the main device local heap is also host visible (integrated GPUs, resizable BAR)
+		bool isUnifiedMemory() const;
+		SorpMemoryStats stats() const;
+
+	private:
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			void* mapped = nullptr;
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeIndex = 0;
+			uint32_t maxOrder = 0;
+			ResourceKind kind = ResourceKind::Linear;
+			VkDeviceSize usedBytes = 0;
+			uint32_t allocationCount = 0;
+			// Free offsets for every buddy order, order k covers MIN_ALLOCATION_SIZE << k bytes
+			std::vector<std::set<VkDeviceSize>> freeLists;
+		};
+
+		VkDevice _device;
+		VkPhysicalDeviceMemoryProperties _memoryProperties;
+		VkDeviceSize _bufferImageGranularity;
+		VkDeviceSize _preferredBlockSize;
+
+		mutable std::mutex _mutex;
+		std::vector<std::unique_ptr<Block>> _blocks;
+		SorpMemoryStats _stats;
+
+		bool separateResourceKinds() const { return _bufferImageGranularity > MIN_ALLOCATION_SIZE; }
+
+		VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped);
+		SorpAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex);
+		uint32_t createBlock(uint32_t memoryTypeIndex, ResourceKind kind);
+		bool allocateFromBlock(uint32_t blockId, uint32_t order, SorpAllocation& allocation);
+		void freeFromBlock(SorpAllocation& allocation);
+		void releaseBlock(uint32_t blockId);
+
+		static uint32_t orderForSize(VkDeviceSize size);
+	};
+}
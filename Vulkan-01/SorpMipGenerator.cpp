@@ -0,0 +1,137 @@
+#include "SorpMipGenerator.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace sorp_v
+{
+	namespace
+	{
+		// Linear values are 16 bit fixed point. Decoding is a lookup per byte, encoding looks up the top 12 bits of
+		// the averaged linear value, which still keeps every sRGB byte in its own bucket so a flat color survives
+		// the round trip unchanged.
+		struct SrgbTables
+		{
+			static constexpr uint32_t ENCODE_SHIFT = 4;
+
+			uint16_t toLinear[256];
+			uint8_t toSrgb[(0xFFFF >> ENCODE_SHIFT) + 1];
+
+			SrgbTables()
+			{
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					double srgb = i / 255.0;
+					double linear = srgb <= 0.04045 ? srgb / 12.92 : std::pow((srgb + 0.055) / 1.055, 2.4);
+					toLinear[i] = static_cast<uint16_t>(std::lround(linear * 0xFFFF));
+				}
+
+				// Nearest sRGB byte to the middle of each bucket, toLinear only grows so the search walks forward
+				uint32_t nearest = 0;
+				for (uint32_t i = 0; i < sizeof(toSrgb); i++)
+				{
+					int32_t linear = static_cast<int32_t>((i << ENCODE_SHIFT) + (1 << (ENCODE_SHIFT - 1)));
+					while (nearest < 255 && std::abs(toLinear[nearest + 1] - linear) <= std::abs(toLinear[nearest] - linear))
+					{
+						nearest++;
+					}
+					toSrgb[i] = static_cast<uint8_t>(nearest);
+				}
+			}
+		};
+
+		const SrgbTables& srgbTables()
+		{
+			static const SrgbTables tables;
+			return tables;
+		}
+	}
+
+	uint32_t SorpMipGenerator::mipLevelCount(uint32_t width, uint32_t height)
+	{
+		uint32_t levels = 1;
+		for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+		{
+			levels++;
+		}
+		return levels;
+	}
+
+	size_t SorpMipGenerator::chainSize(uint32_t width, uint32_t height, uint32_t mipLevels)
+	{
+		size_t size = 0;
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			size += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * BYTES_PER_PIXEL;
+		}
+		return size;
+	}
+
+	std::vector<VkBufferImageCopy> SorpMipGenerator::generate(SorpJobSystem& jobSystem, uint8_t* chain, uint32_t width,
+		uint32_t height, uint32_t mipLevels)
+	{
+		SORP_PROFILE_SCOPE("generate mips");
+
+		std::vector<VkBufferImageCopy> regions(mipLevels);
+		size_t offset = 0;
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			uint32_t levelWidth = std::max(width >> level, 1u);
+			uint32_t levelHeight = std::max(height >> level, 1u);
+
+			VkBufferImageCopy& region = regions[level];
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { levelWidth, levelHeight, 1 };
+
+			if (level > 0)
+			{
+				uint32_t srcWidth = std::max(width >> (level - 1), 1u);
+				uint32_t srcHeight = std::max(height >> (level - 1), 1u);
+				const uint8_t* src = chain + regions[level - 1].bufferOffset;
+				uint8_t* dst = chain + offset;
+
+				// Each level depends on the previous one, only the rows within a level run in parallel
+				uint32_t grainRows = std::max(PIXELS_PER_JOB / levelWidth, 1u);
+				jobSystem.parallelFor(levelHeight, grainRows, [&](uint32_t first, uint32_t count)
+				{
+					for (uint32_t y = first; y < first + count; y++)
+					{
+						const uint8_t* row0 = src + static_cast<size_t>(std::min(y * 2, srcHeight - 1)) * srcWidth * BYTES_PER_PIXEL;
+						const uint8_t* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * BYTES_PER_PIXEL;
+						downsampleRow(row0, row1, srcWidth, dst + static_cast<size_t>(y) * levelWidth * BYTES_PER_PIXEL, levelWidth);
+					}
+				});
+			}
+
+			offset += static_cast<size_t>(levelWidth) * levelHeight * BYTES_PER_PIXEL;
+		}
+		return regions;
+	}
+
+	void SorpMipGenerator::downsampleRow(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth, uint8_t* dst, uint32_t dstWidth)
+	{
+		const SrgbTables& tables = srgbTables();
+		for (uint32_t x = 0; x < dstWidth; x++)
+		{
+			uint32_t x0 = std::min(x * 2, srcWidth - 1) * BYTES_PER_PIXEL;
+			uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * BYTES_PER_PIXEL;
+			uint8_t* pixel = dst + x * BYTES_PER_PIXEL;
+
+			// Color is averaged in linear space like a blit of an sRGB image, alpha is already linear
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				uint32_t sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]]
+					+ tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+				pixel[c] = tables.toSrgb[((sum + 2) / 4) >> SrgbTables::ENCODE_SHIFT];
+			}
+			pixel[3] = static_cast<uint8_t>((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+		}
+	}
+}
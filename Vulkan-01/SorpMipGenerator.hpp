@@ -0,0 +1,34 @@
+#pragma once
+
+#include "SorpJobSystem.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sorp_v
+{
+	// CPU mip chain generation for RGBA8 sRGB images whose format can't be blitted with linear filtering. Every level
+	// is a 2x2 box filter of the one above, averaged in linear space and split across the job system by rows.
+	class SorpMipGenerator
+	{
+	public:
+		static constexpr uint32_t BYTES_PER_PIXEL = 4;
+
+		// Down to 1x1
+		static uint32_t mipLevelCount(uint32_t width, uint32_t height);
+		// Levels are tightly packed one after the other, level 0 first
+		static size_t chainSize(uint32_t width, uint32_t height, uint32_t mipLevels);
+
+		// chain holds level 0 and has room for chainSize() bytes. Fills levels 1.. and returns the copy regions of
+		// every level relative to the start of chain.
+		static std::vector<VkBufferImageCopy> generate(SorpJobSystem& jobSystem, uint8_t* chain, uint32_t width,
+			uint32_t height, uint32_t mipLevels);
+
+	private:
+		static constexpr uint32_t PIXELS_PER_JOB = 16 * 1024;
+
+		static void downsampleRow(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth, uint8_t* dst, uint32_t dstWidth);
+	};
+}
@@ -4,7 +4,7 @@
 
 namespace sorp_v
 {
-	SorpModel::SorpModel(SorpRenderDevice &device, const std::vector<Vertex> &vertices, const std::vector<uint16_t>& indexes) : _renderDevice{device}
+	SorpModel::SorpModel(SorpGeometryArena &geometryArena, const std::vector<Vertex> &vertices, const std::vector<uint16_t>& indexes) : _geometryArena{geometryArena}
 	{
 		createVertexBuffers(vertices);
 		createIndexBuffers(indexes);
@@ -12,77 +12,66 @@ namespace sorp_v
 
 	SorpModel::~SorpModel()
 	{
-		vkDestroyBuffer(_renderDevice.device(), _vertexBuffer, nullptr);
-		vkFreeMemory(_renderDevice.device(), _vertexBufferMemory, nullptr);
-
-		vkDestroyBuffer(_renderDevice.device(), _indexBuffer, nullptr);
-		vkFreeMemory(_renderDevice.device(), _indexBufferMemory, nullptr);
-	}
-
-	void SorpModel::bind(VkCommandBuffer commandBuffer)
-	{
-		VkBuffer vertexBuffers[] = { _vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-		vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+		// The ranges only become reusable once no frame in flight reads them
+		SorpGeometryArena* geometryArena = &_geometryArena;
+		SorpGeometryArena::Range vertices = _vertices;
+		SorpGeometryArena::Range indexes = _indexes;
+		_geometryArena.renderDevice().deferDestroy([geometryArena, vertices, indexes]()
+		{
+			geometryArena->freeVertices(vertices);
+			geometryArena->freeIndices(indexes);
+		});
 	}
 
-	void SorpModel::draw(VkCommandBuffer commandBuffer)
+	void SorpModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance)
 	{
-		vkCmdDrawIndexed(commandBuffer, _indexCount, 1, 0, 0, 0);
+		vkCmdDrawIndexed(commandBuffer, _indexes.count, instanceCount, _indexes.first, vertexOffset(), firstInstance);
 	}
 
 	void SorpModel::createVertexBuffers(const std::vector<Vertex>& vertices)
 	{
-		_vertexCount = static_cast<uint32_t>(vertices.size());
-		assert(_vertexCount >= 3 && "Vertex count must be at least 3");
-
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-		
-
-		_renderDevice.createBuffer(bufferSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			_vertexBuffer,
-			_vertexBufferMemory);
-		
-		void* data;
-		vkMapMemory(_renderDevice.device(), _vertexBufferMemory, 0, bufferSize, 0,&data);
-
-		memcpy(data, vertices.data(), (size_t)bufferSize);
-		vkUnmapMemory(_renderDevice.device(), _vertexBufferMemory);
+		uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		assert(vertexCount >= 3 && "Vertex count must be at least 3");
+
+		_vertices = _geometryArena.allocateVertices(vertices.data(), vertexCount);
+
+		glm::vec3 minBounds = vertices[0].position;
+		glm::vec3 maxBounds = vertices[0].position;
+		for (const auto& vertex : vertices)
+		{
+			minBounds = glm::min(minBounds, vertex.position);
+			maxBounds = glm::max(maxBounds, vertex.position);
+		}
+
+		glm::vec3 center = (minBounds + maxBounds) * 0.5f;
+		float radius = 0.0f;
+		for (const auto& vertex : vertices)
+		{
+			radius = glm::max(radius, glm::length(vertex.position - center));
+		}
+		_boundingSphere = glm::vec4(center, radius);
 	}
 
 	void SorpModel::createIndexBuffers(const std::vector<uint16_t>& indexes)
 	{
-		_indexCount = static_cast<uint32_t>(indexes.size());
-		assert(_indexCount >= 3 && "Index count must be at least 3");
-
-		VkDeviceSize bufferSize = sizeof(indexes[0]) * indexes.size();
+		uint32_t indexCount = static_cast<uint32_t>(indexes.size());
+		assert(indexCount >= 3 && "Index count must be at least 3");
 
-		_renderDevice.createBuffer(bufferSize,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			_indexBuffer,
-			_indexBufferMemory);
-
-		void* data;
-		vkMapMemory(_renderDevice.device(), _indexBufferMemory, 0, bufferSize, 0, &data);
-
-		memcpy(data, indexes.data(), (size_t)bufferSize);
-		vkUnmapMemory(_renderDevice.device(), _indexBufferMemory);
+		_indexes = _geometryArena.allocateIndices(indexes.data(), indexCount);
 	}
 
 	std::vector<VkVertexInputBindingDescription> SorpModel::Vertex::getBindingDescriptions()
 	{
-		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(2);
 		
 		bindingDescriptions[0].binding = 0;
 		bindingDescriptions[0].stride = sizeof(Vertex);
 		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
+		bindingDescriptions[1].binding = 1;
+		bindingDescriptions[1].stride = sizeof(InstanceData);
+		bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
 		return bindingDescriptions;
 	}
 
@@ -105,6 +94,31 @@ namespace sorp_v
 		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
 		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
 
+		// A mat4 attribute takes one location per column
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			VkVertexInputAttributeDescription modelColumn{};
+			modelColumn.binding = 1;
+			modelColumn.location = 3 + column;
+			modelColumn.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			modelColumn.offset = static_cast<uint32_t>(offsetof(InstanceData, model) + sizeof(glm::vec4) * column);
+			attributeDescriptions.push_back(modelColumn);
+		}
+
+		VkVertexInputAttributeDescription instanceColor{};
+		instanceColor.binding = 1;
+		instanceColor.location = 7;
+		instanceColor.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		instanceColor.offset = offsetof(InstanceData, color);
+		attributeDescriptions.push_back(instanceColor);
+
+		VkVertexInputAttributeDescription materialIndex{};
+		materialIndex.binding = 1;
+		materialIndex.location = 8;
+		materialIndex.format = VK_FORMAT_R32_UINT;
+		materialIndex.offset = offsetof(InstanceData, materialIndex);
+		attributeDescriptions.push_back(materialIndex);
+
 		return attributeDescriptions;
 	}
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "SorpRenderDevice.hpp"
+#include "SorpGeometryArena.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -24,26 +24,38 @@ namespace sorp_v
 			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
 		};
 
-		SorpModel(SorpRenderDevice &renderDevice, const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indexes);
+		// Per instance stream, read from binding 1 at VK_VERTEX_INPUT_RATE_INSTANCE. Matches InstanceData in cull.comp (std430).
+		// The material index travels here rather than in push constants, so a whole range of indirect draws can go out in one call.
+		struct InstanceData
+		{
+			glm::mat4 model;
+			glm::vec4 color;
+			uint32_t materialIndex;		// bindless texture slot
+			uint32_t _padding[3];
+		};
+
+		SorpModel(SorpGeometryArena &geometryArena, const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indexes);
 		~SorpModel();
 
 		SorpModel(const SorpModel&) = delete;
 		SorpModel &operator=(const SorpModel&) = delete;
 
-		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		// Expects the arena and an instance buffer to be bound
+		void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+		uint32_t indexCount() const { return _indexes.count; }
+		uint32_t firstIndex() const { return _indexes.first; }
+		int32_t vertexOffset() const { return static_cast<int32_t>(_vertices.first); }
+		// Object space center in xyz, radius in w
+		glm::vec4 boundingSphere() const { return _boundingSphere; }
 	private:
 		void createVertexBuffers(const std::vector<Vertex> &vertices);
 		void createIndexBuffers(const std::vector<uint16_t> &indexes);
 
-		SorpRenderDevice& _renderDevice;
-
-		VkBuffer _vertexBuffer;
-		VkDeviceMemory _vertexBufferMemory;
-		uint32_t _vertexCount;
+		SorpGeometryArena& _geometryArena;
 
-		VkBuffer _indexBuffer;
-		VkDeviceMemory _indexBufferMemory;
-		uint32_t _indexCount;
+		SorpGeometryArena::Range _vertices;
+		SorpGeometryArena::Range _indexes;
+		glm::vec4 _boundingSphere;
 	};
 }
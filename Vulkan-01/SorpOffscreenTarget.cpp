@@ -0,0 +1,189 @@
+#include "SorpOffscreenTarget.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <array>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpOffscreenTarget::SorpOffscreenTarget(SorpRenderDevice& renderDevice, VkExtent2D extent, uint32_t imageCount) :
+		_renderDevice{renderDevice}, _extent{extent}, _depthFormat{renderDevice.findDepthFormat()}
+	{
+		createRenderPass();
+		createImages(imageCount);
+	}
+
+	SorpOffscreenTarget::~SorpOffscreenTarget()
+	{
+		VkDevice device = _renderDevice.device();
+		for (auto& images : _images)
+		{
+			VkFramebuffer frameBuffer = images.frameBuffer;
+			VkImageView colorView = images.colorView;
+			VkImageView depthView = images.depthView;
+			_renderDevice.deferDestroy([device, frameBuffer, colorView, depthView]()
+			{
+				vkDestroyFramebuffer(device, frameBuffer, nullptr);
+				vkDestroyImageView(device, colorView, nullptr);
+				vkDestroyImageView(device, depthView, nullptr);
+			});
+			_renderDevice.deferDestroyImage(images.color, images.colorAllocation);
+			_renderDevice.deferDestroyImage(images.depth, images.depthAllocation);
+		}
+
+		VkRenderPass renderPass = _renderPass;
+		_renderDevice.deferDestroy([device, renderPass]()
+		{
+			vkDestroyRenderPass(device, renderPass, nullptr);
+		});
+	}
+
+	VkResult SorpOffscreenTarget::acquireNextImage(const SorpFrameContext& frame, uint32_t* imageIndex)
+	{
+		*imageIndex = frame.index;
+		return VK_SUCCESS;
+	}
+
+	VkResult SorpOffscreenTarget::submitCommandBuffers(const SorpFrameContext& frame, uint32_t*)
+	{
+		SORP_PROFILE_SCOPE("submitCommandBuffers");
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+		vkResetFences(_renderDevice.device(), 1, &frame.inFlightFence);
+		if (vkQueueSubmit(_renderDevice.graphicsQueue(), 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit draw command buffer!");
+		}
+		return VK_SUCCESS;
+	}
+
+	void SorpOffscreenTarget::createRenderPass()
+	{
+		VkAttachmentDescription colorAttachment{};
+		colorAttachment.format = COLOR_FORMAT;
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Ready to be copied out for image comparisons
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		VkAttachmentDescription depthAttachment{};
+		depthAttachment.format = _depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorAttachmentRef{};
+		colorAttachmentRef.attachment = 0;
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		// Same as the swap chain pass so pipelines built against either stay compatible
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.srcAccessMask = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependency.dstSubpass = 0;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 1;
+		renderPassInfo.pDependencies = &dependency;
+
+		if (vkCreateRenderPass(_renderDevice.device(), &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create offscreen render pass!");
+		}
+	}
+
+	void SorpOffscreenTarget::createImages(uint32_t imageCount)
+	{
+		_images.resize(imageCount);
+		for (auto& images : _images)
+		{
+			createAttachment(COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				VK_IMAGE_ASPECT_COLOR_BIT, images.color, images.colorAllocation, images.colorView);
+			createAttachment(_depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+				VK_IMAGE_ASPECT_DEPTH_BIT, images.depth, images.depthAllocation, images.depthView);
+
+			std::array<VkImageView, 2> attachments = { images.colorView, images.depthView };
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = _renderPass;
+			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			framebufferInfo.pAttachments = attachments.data();
+			framebufferInfo.width = _extent.width;
+			framebufferInfo.height = _extent.height;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(_renderDevice.device(), &framebufferInfo, nullptr, &images.frameBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create offscreen framebuffer!");
+			}
+		}
+	}
+
+	void SorpOffscreenTarget::createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+		VkImage& image, SorpAllocation& allocation, VkImageView& view)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = _extent.width;
+		imageInfo.extent.height = _extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = usage;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		_renderDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, allocation);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange.aspectMask = aspect;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(_renderDevice.device(), &viewInfo, nullptr, &view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create offscreen image view!");
+		}
+	}
+}
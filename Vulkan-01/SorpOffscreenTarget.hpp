@@ -0,0 +1,59 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpRenderTarget.hpp"
+
+#include <vector>
+
+namespace sorp_v
+{
+	// Color and depth images rendered to without a surface, one set per frame in flight so consecutive frames
+	// don't wait on each other. Nothing is presented, a submitted frame is done once its fence signals.
+	class SorpOffscreenTarget : public SorpRenderTarget
+	{
+	public:
+		static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+		SorpOffscreenTarget(SorpRenderDevice& renderDevice, VkExtent2D extent,
+			uint32_t imageCount = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT);
+		~SorpOffscreenTarget() override;
+
+		SorpOffscreenTarget(const SorpOffscreenTarget&) = delete;
+		SorpOffscreenTarget& operator=(const SorpOffscreenTarget&) = delete;
+
+		VkRenderPass renderPass() override { return _renderPass; }
+		VkFramebuffer frameBuffer(uint32_t imageIndex) override { return _images[imageIndex].frameBuffer; }
+		VkExtent2D extent() override { return _extent; }
+		VkFormat colorFormat() override { return COLOR_FORMAT; }
+
+		// Image i belongs to frame context i
+		VkResult acquireNextImage(const SorpFrameContext& frame, uint32_t* imageIndex) override;
+		VkResult submitCommandBuffers(const SorpFrameContext& frame, uint32_t* imageIndex) override;
+
+		// Left in TRANSFER_SRC_OPTIMAL once its frame completed
+		VkImage colorImage(uint32_t imageIndex) const { return _images[imageIndex].color; }
+
+	private:
+		struct TargetImages
+		{
+			VkImage color = VK_NULL_HANDLE;
+			SorpAllocation colorAllocation;
+			VkImageView colorView = VK_NULL_HANDLE;
+			VkImage depth = VK_NULL_HANDLE;
+			SorpAllocation depthAllocation;
+			VkImageView depthView = VK_NULL_HANDLE;
+			VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		VkExtent2D _extent;
+		VkFormat _depthFormat;
+		VkRenderPass _renderPass = VK_NULL_HANDLE;
+		std::vector<TargetImages> _images;
+
+		void createRenderPass();
+		void createImages(uint32_t imageCount);
+		void createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+			VkImage& image, SorpAllocation& allocation, VkImageView& view);
+	};
+}
@@ -0,0 +1,153 @@
+#include "SorpParallelRecorder.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpParallelRecorder::SorpParallelRecorder(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem, uint32_t frameCount,
+		uint32_t minItemsPerThread) :
+		_renderDevice{renderDevice}, _jobSystem{jobSystem}, _minItemsPerThread{std::max(minItemsPerThread, 1u)}
+	{
+		createCommandPools(frameCount);
+	}
+
+	SorpParallelRecorder::~SorpParallelRecorder()
+	{
+		VkDevice device = _renderDevice.device();
+		for (auto& frame : _threadFrames)
+		{
+			for (auto& threadFrame : frame)
+			{
+				// Secondaries from these pools may still be executing
+				VkCommandPool commandPool = threadFrame.commandPool;
+				_renderDevice.deferDestroy([device, commandPool]() { vkDestroyCommandPool(device, commandPool, nullptr); });
+			}
+		}
+	}
+
+	void SorpParallelRecorder::beginFrame(uint32_t frameIndex)
+	{
+		_currentFrame = frameIndex;
+		for (auto& threadFrame : _threadFrames[frameIndex])
+		{
+			vkResetCommandPool(_renderDevice.device(), threadFrame.commandPool, 0);
+			threadFrame.usedCommandBuffers = 0;
+		}
+	}
+
+	void SorpParallelRecorder::record(VkCommandBuffer primaryCommandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo,
+		uint32_t itemCount, const RecordFunction& recordFunction)
+	{
+		if (itemCount == 0)
+		{
+			return;
+		}
+
+		uint32_t sliceCount = std::min(_jobSystem.threadCount(), (itemCount + _minItemsPerThread - 1) / _minItemsPerThread);
+		uint32_t sliceSize = (itemCount + sliceCount - 1) / sliceCount;
+		std::vector<VkCommandBuffer> secondaries(sliceCount, VK_NULL_HANDLE);
+		// Jobs must not throw, failures are carried back and rethrown here
+		std::vector<std::exception_ptr> errors(sliceCount);
+
+		_jobSystem.parallelFor(sliceCount, 1, [&](uint32_t firstSlice, uint32_t sliceRange)
+		{
+			for (uint32_t slice = firstSlice; slice < firstSlice + sliceRange; slice++)
+			{
+				uint32_t first = slice * sliceSize;
+				if (first >= itemCount)
+				{
+					continue;
+				}
+				uint32_t count = std::min(sliceSize, itemCount - first);
+				SORP_PROFILE_SCOPE("record secondary");
+
+				try
+				{
+					// Any thread may pick up any slice, the pool just has to belong to the thread that records
+					VkCommandBuffer commandBuffer = acquireCommandBuffer(_jobSystem.threadIndex());
+
+					VkCommandBufferBeginInfo beginInfo{};
+					beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+					beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+					beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+					if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+					{
+						throw std::runtime_error("failed to begin recording secondary command buffer!");
+					}
+
+					recordFunction(commandBuffer, first, count);
+
+					if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+					{
+						throw std::runtime_error("failed to record secondary command buffer!");
+					}
+					secondaries[slice] = commandBuffer;
+				}
+				catch (...)
+				{
+					errors[slice] = std::current_exception();
+				}
+			}
+		});
+
+		for (const auto& error : errors)
+		{
+			if (error)
+			{
+				std::rethrow_exception(error);
+			}
+		}
+
+		secondaries.erase(std::remove(secondaries.begin(), secondaries.end(), VK_NULL_HANDLE), secondaries.end());
+		vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	}
+
+	void SorpParallelRecorder::createCommandPools(uint32_t frameCount)
+	{
+		QueueFamilyIndices queueFamilyIndices = _renderDevice.findPhysicalQueueFamilies();
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		_threadFrames.resize(frameCount);
+		for (auto& frame : _threadFrames)
+		{
+			frame.resize(_jobSystem.threadCount());
+			for (auto& threadFrame : frame)
+			{
+				if (vkCreateCommandPool(_renderDevice.device(), &poolInfo, nullptr, &threadFrame.commandPool) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create command pool!");
+				}
+			}
+		}
+	}
+
+	VkCommandBuffer SorpParallelRecorder::acquireCommandBuffer(uint32_t threadIndex)
+	{
+		ThreadFrame& threadFrame = _threadFrames[_currentFrame][threadIndex];
+		if (threadFrame.usedCommandBuffers == threadFrame.commandBuffers.size())
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = threadFrame.commandPool;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(_renderDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failled to allocate command buffer");
+			}
+			threadFrame.commandBuffers.push_back(commandBuffer);
+		}
+
+		return threadFrame.commandBuffers[threadFrame.usedCommandBuffers++];
+	}
+}
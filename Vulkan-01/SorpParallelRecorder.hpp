@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SorpJobSystem.hpp"
+#include "SorpRenderDevice.hpp"
+#include "SorpFrameContext.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace sorp_v
+{
+	// Splits a draw list across the job system, each slice is recorded into a secondary command buffer from the
+	// executing thread's own per frame command pool. The primary buffer then runs them with vkCmdExecuteCommands, so its render pass has to be
+	// begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+	class SorpParallelRecorder
+	{
+	public:
+		// Records items [first, first + count). Nothing is inherited from the primary buffer except the
+		// render pass, so pipelines, descriptor sets and vertex buffers have to be bound again.
+		using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+		// Below this many items per slice the cost of another secondary outweighs recording in parallel
+		static constexpr uint32_t DEFAULT_MIN_ITEMS_PER_THREAD = 16;
+
+		SorpParallelRecorder(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem,
+			uint32_t frameCount = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT, uint32_t minItemsPerThread = DEFAULT_MIN_ITEMS_PER_THREAD);
+		~SorpParallelRecorder();
+
+		SorpParallelRecorder(const SorpParallelRecorder&) = delete;
+		SorpParallelRecorder& operator=(const SorpParallelRecorder&) = delete;
+
+		// Resets the frame's command pools, the frame's fence must have been waited on
+		void beginFrame(uint32_t frameIndex);
+		// Call from a single thread outside the job system, it shares thread index 0 with every other external thread
+		void record(VkCommandBuffer primaryCommandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo,
+			uint32_t itemCount, const RecordFunction& recordFunction);
+
+
+	private:
+		struct ThreadFrame
+		{
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> commandBuffers;
+			uint32_t usedCommandBuffers = 0;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		SorpJobSystem& _jobSystem;
+		uint32_t _minItemsPerThread;
+		uint32_t _currentFrame = 0;
+
+		// Indexed [frame][job system thread]
+		std::vector<std::vector<ThreadFrame>> _threadFrames;
+
+		void createCommandPools(uint32_t frameCount);
+		VkCommandBuffer acquireCommandBuffer(uint32_t threadIndex);
+	};
+}
@@ -1,6 +1,6 @@
 #include "SorpPathResolver.h"
 
-#include <Windows.h>
+#include <stdexcept>
 
 namespace sorp_v
 {
@@ -18,12 +18,22 @@ namespace sorp_v {
 	}
 	
 	SorpPipeline::~SorpPipeline() {
-		vkDestroyShaderModule(_renderDevice.device(), _vertShaderModel, nullptr);
-		vkDestroyShaderModule(_renderDevice.device(), _fragShaderModel, nullptr);
-		vkDestroyPipeline(_renderDevice.device(), _graphicsPipeline, nullptr);
+		// Frames in flight may still reference the pipeline
+		VkDevice device = _renderDevice.device();
+		VkShaderModule vertShaderModule = _vertShaderModel;
+		VkShaderModule fragShaderModule = _fragShaderModel;
+		VkPipeline pipeline = _graphicsPipeline;
+		VkPipelineLayout pipelineLayout = _ownsPipelineLayout ? _pipelineLayout : VK_NULL_HANDLE;
+		_renderDevice.deferDestroy([device, vertShaderModule, fragShaderModule, pipeline, pipelineLayout]()
+		{
+			vkDestroyShaderModule(device, vertShaderModule, nullptr);
+			vkDestroyShaderModule(device, fragShaderModule, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		});
 	}
 
-	PipelineConfiguration SorpPipeline::defaultPipelineConfiguration(uint32_t width, uint32_t height)
+	PipelineConfiguration SorpPipeline::defaultPipelineConfiguration()
 	{
 		PipelineConfiguration configInfo{};
 
@@ -31,16 +41,6 @@ namespace sorp_v {
 		configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		configInfo.inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-		configInfo.viewport.x = 0.0f;
-		configInfo.viewport.y = 0.0f;
-		configInfo.viewport.width = static_cast<float>(width);
-		configInfo.viewport.height = static_cast<float>(height);
-		configInfo.viewport.minDepth = 0.0f;
-		configInfo.viewport.maxDepth = 1.0f;
-
-		configInfo.scissor.offset = {0, 0};
-		configInfo.scissor.extent = {width, height};
-
 		configInfo.rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		configInfo.rasterizationInfo.depthClampEnable = VK_FALSE;
 		configInfo.rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
@@ -93,6 +93,8 @@ namespace sorp_v {
 		configInfo.depthStencilInfo.front = {};  // Optional
 		configInfo.depthStencilInfo.back = {};   // Optional
 
+		configInfo.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
 		return configInfo;
 	}
 
@@ -122,8 +124,7 @@ namespace sorp_v {
 	void SorpPipeline::createGraphicsPipeline(const std::string vertShader, const std::string fragShader, const PipelineConfiguration& config)
 	{
 		assert(config.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline. No renderPass is specified");
-		assert(config.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline. No pipelineLayout is specified");
-
+		createPipelineLayout(config);
 
 		auto vertCode = readFile(vertShader);
 		auto fragCode = readFile(fragShader);
@@ -139,7 +140,7 @@ namespace sorp_v {
 		shadersStages[0].pName = "main";
 		shadersStages[0].flags = 0;
 		shadersStages[0].pNext = nullptr;
-		shadersStages[0].pSpecializationInfo = nullptr;
+		shadersStages[0].pSpecializationInfo = config.specializationInfo;
 
 		shadersStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shadersStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -147,7 +148,7 @@ namespace sorp_v {
 		shadersStages[1].pName = "main";
 		shadersStages[1].flags = 0;
 		shadersStages[1].pNext = nullptr;
-		shadersStages[1].pSpecializationInfo = nullptr;
+		shadersStages[1].pSpecializationInfo = config.specializationInfo;
 
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 
@@ -162,9 +163,14 @@ namespace sorp_v {
 		VkPipelineViewportStateCreateInfo viewportInfo{};
 		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &config.viewport;
+		viewportInfo.pViewports = nullptr;
 		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &config.scissor;
+		viewportInfo.pScissors = nullptr;
+
+		VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+		dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(config.dynamicStates.size());
+		dynamicStateInfo.pDynamicStates = config.dynamicStates.data();
 
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -177,21 +183,43 @@ namespace sorp_v {
 		pipelineInfo.pMultisampleState = &config.multisampleInfo;
 		pipelineInfo.pColorBlendState = &config.colorBlendInfo;
 		pipelineInfo.pDepthStencilState = &config.depthStencilInfo;
-		pipelineInfo.pDynamicState = nullptr;
+		pipelineInfo.pDynamicState = &dynamicStateInfo;
 
-		pipelineInfo.layout = config.pipelineLayout;
+		pipelineInfo.layout = _pipelineLayout;
 		pipelineInfo.renderPass = config.renderPass;
 		pipelineInfo.subpass = config.subpass;
 
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(_renderDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(_renderDevice.device(), _renderDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create graphics pipeline!");
 		}
 	}
 
+	void SorpPipeline::createPipelineLayout(const PipelineConfiguration& config)
+	{
+		if (config.pipelineLayout != VK_NULL_HANDLE)
+		{
+			_pipelineLayout = config.pipelineLayout;
+			return;
+		}
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = static_cast<uint32_t>(config.descriptorSetLayouts.size());
+		layoutInfo.pSetLayouts = config.descriptorSetLayouts.data();
+		layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(config.pushConstantRanges.size());
+		layoutInfo.pPushConstantRanges = config.pushConstantRanges.data();
+
+		if (vkCreatePipelineLayout(_renderDevice.device(), &layoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Couldnt create pipeline layout");
+		}
+		_ownsPipelineLayout = true;
+	}
+
 	void SorpPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModel)
 	{
 		VkShaderModuleCreateInfo createInfo{};
@@ -8,14 +8,19 @@
 namespace sorp_v
 {
 	struct PipelineConfiguration {
-		VkViewport viewport;
-		VkRect2D scissor;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
 		VkPipelineMultisampleStateCreateInfo multisampleInfo;
 		VkPipelineColorBlendAttachmentState colorBlendAttachment;
 		VkPipelineColorBlendStateCreateInfo colorBlendInfo;
 		VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+		// Viewport and scissor are always dynamic so pipelines outlive swapchain resizes
+		std::vector<VkDynamicState> dynamicStates;
+		// Used when pipelineLayout is null, the pipeline then creates and owns its layout
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+		std::vector<VkPushConstantRange> pushConstantRanges;
+		// Applied to both shader stages, has to stay alive until the pipeline is created
+		const VkSpecializationInfo* specializationInfo = nullptr;
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
@@ -35,19 +40,24 @@ namespace sorp_v
 		SorpPipeline& operator=(const SorpPipeline&) = delete;
 		SorpPipeline() = default;
 
-		static PipelineConfiguration defaultPipelineConfiguration(uint32_t width, uint32_t height);
+		static PipelineConfiguration defaultPipelineConfiguration();
 
 		void bind(VkCommandBuffer command);
 
+		VkPipelineLayout pipelineLayout() const { return _pipelineLayout; }
+
+		static std::vector<char> readFile(const std::string& filePath);
+
 	private:
 		SorpRenderDevice& _renderDevice;
 		VkPipeline _graphicsPipeline;
+		VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+		bool _ownsPipelineLayout = false;
 		VkShaderModule _vertShaderModel;
 		VkShaderModule _fragShaderModel;
 
-		static std::vector<char> readFile(const std::string& filePath);
-
 		void createGraphicsPipeline(const std::string vertShader, const std::string fragShader, const PipelineConfiguration& config);
+		void createPipelineLayout(const PipelineConfiguration& config);
 	
 		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModel);
 	};
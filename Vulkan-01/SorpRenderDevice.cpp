@@ -1,8 +1,14 @@
 #include "SorpRenderDevice.hpp"
 
+#include "SorpUploadQueue.hpp"
+
 // std headers
+#include <algorithm>
 #include <cstring>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <set>
 #include <unordered_set>
 
@@ -48,16 +54,25 @@ namespace sorp_v {
     }
 
     // class member functions
-    SorpRenderDevice::SorpRenderDevice(SorpWindow& window) : _window{ window } {
+    SorpRenderDevice::SorpRenderDevice(SorpWindow* window, bool headlessSurface)
+        : _window{ window }, _headlessSurface{ headlessSurface } {
         createInstance();
         setupDebugMessenger();
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
+        createPipelineCache();
+        createAllocator();
         createCommandPool();
+        createUploadQueue();
     }
 
     SorpRenderDevice::~SorpRenderDevice() {
+        flushDeletions();
+        _uploadQueue.reset();
+        _allocator.reset();
+        savePipelineCache();
+        vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
         vkDestroyCommandPool(_device, _commandPool, nullptr);
         vkDestroyDevice(_device, nullptr);
 
@@ -65,7 +80,9 @@ namespace sorp_v {
             DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
         }
 
-        vkDestroySurfaceKHR(_instance, _surface, nullptr);
+        if (_surface != VK_NULL_HANDLE) {
+            vkDestroySurfaceKHR(_instance, _surface, nullptr);
+        }
         vkDestroyInstance(_instance, nullptr);
     }
 
@@ -80,7 +97,8 @@ namespace sorp_v {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // 1.1 for vkGetPhysicalDeviceFeatures2, everything past 1.0 is optional
+        appInfo.apiVersion = VK_API_VERSION_1_1;
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -151,18 +169,42 @@ namespace sorp_v {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+        deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+        enabledFeatures = deviceFeatures;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+        timestampValidBits = queueFamilies[indices.graphicsFamily].timestampValidBits;
+
+        std::vector<const char*> extensions = _deviceExtensions;
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        if (queryDescriptorIndexing(indexingFeatures)) {
+            extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = descriptorIndexingEnabled ? &indexingFeatures : nullptr;
 
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(_deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = _deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 
         // might not really be necessary anymore because device specific validation layers
         // have been deprecated
@@ -182,6 +224,62 @@ namespace sorp_v {
         vkGetDeviceQueue(_device, indices.presentFamily, 0, &_presentQueue);
     }
 
+    void SorpRenderDevice::createPipelineCache() {
+        std::vector<char> cacheData;
+        std::ifstream file{ PIPELINE_CACHE_FILE, std::ios::binary };
+        if (file.is_open()) {
+            cacheData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        // The driver is supposed to reject foreign data itself, but not every driver does it gracefully
+        VkPipelineCacheHeaderVersionOne header = {};
+        bool validCache = cacheData.size() >= sizeof(header);
+        if (validCache) {
+            memcpy(&header, cacheData.data(), sizeof(header));
+            validCache = header.headerSize >= sizeof(header) &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        if (!validCache && !cacheData.empty()) {
+            std::cout << "pipeline cache belongs to another device or driver, starting cold" << std::endl;
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = validCache ? cacheData.size() : 0;
+        cacheInfo.pInitialData = validCache ? cacheData.data() : nullptr;
+
+        if (vkCreatePipelineCache(_device, &cacheInfo, nullptr, &_pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    void SorpRenderDevice::savePipelineCache() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            return;
+        }
+
+        std::vector<char> cacheData(dataSize);
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        // Write next to the old file first so a crash mid write can't leave a truncated cache behind
+        std::string tempFile = PIPELINE_CACHE_FILE + ".tmp";
+        {
+            std::ofstream file{ tempFile, std::ios::binary | std::ios::trunc };
+            if (!file.is_open()) {
+                return;
+            }
+            file.write(cacheData.data(), static_cast<std::streamsize>(dataSize));
+        }
+        std::remove(PIPELINE_CACHE_FILE.c_str());
+        std::rename(tempFile.c_str(), PIPELINE_CACHE_FILE.c_str());
+    }
+
     void SorpRenderDevice::createCommandPool() {
         QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
 
@@ -196,15 +294,41 @@ namespace sorp_v {
         }
     }
 
-    void SorpRenderDevice::createSurface() { _window.createWindowSurface(_instance, &_surface); }
+    void SorpRenderDevice::createAllocator() {
+        _allocator = std::make_unique<SorpMemoryAllocator>(_physicalDevice, _device);
+    }
+
+    void SorpRenderDevice::createUploadQueue() {
+        _uploadQueue = std::make_unique<SorpUploadQueue>(*this);
+    }
+
+    void SorpRenderDevice::createSurface() {
+        if (_window != nullptr) {
+            _window->createWindowSurface(_instance, &_surface);
+            return;
+        }
+
+        if (!_headlessSurface) {
+            // Nothing gets presented, so there is no need for a swap chain
+            _deviceExtensions.clear();
+            return;
+        }
+
+        auto func = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(_instance, "vkCreateHeadlessSurfaceEXT");
+        VkHeadlessSurfaceCreateInfoEXT createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+        if (func == nullptr || func(_instance, &createInfo, nullptr, &_surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create headless surface");
+        }
+    }
 
     bool SorpRenderDevice::isDeviceSuitable(VkPhysicalDevice device) {
         QueueFamilyIndices indices = findQueueFamilies(device);
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = _surface == VK_NULL_HANDLE;
+        if (extensionsSupported && _surface != VK_NULL_HANDLE) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
@@ -264,11 +388,17 @@ namespace sorp_v {
     }
 
     std::vector<const char*> SorpRenderDevice::getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        std::vector<const char*> extensions;
+        if (_window != nullptr) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
+        else if (_headlessSurface) {
+            extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -295,9 +425,70 @@ namespace sorp_v {
         for (const auto& required : requiredExtensions) {
             std::cout << "\t" << required << std::endl;
             if (available.find(required) == available.end()) {
-                throw std::runtime_error("Missing required glfw extension");
+                throw std::runtime_error("Missing required instance extension");
+            }
+        }
+    }
+
+    bool SorpRenderDevice::queryDescriptorIndexing(VkPhysicalDeviceDescriptorIndexingFeaturesEXT& enabled) {
+        // A table shaders can't index with a material id is no use
+        if (properties.apiVersion < VK_API_VERSION_1_1 || !enabledFeatures.shaderSampledImageArrayDynamicIndexing ||
+            !hasDeviceExtension(_physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &supported;
+        vkGetPhysicalDeviceFeatures2(_physicalDevice, &features2);
+
+        // Everything the bindless texture table relies on, anything less falls back to per frame sets
+        if (!supported.descriptorBindingSampledImageUpdateAfterBind ||
+            !supported.descriptorBindingUpdateUnusedWhilePending ||
+            !supported.descriptorBindingPartiallyBound ||
+            !supported.descriptorBindingVariableDescriptorCount) {
+            return false;
+        }
+
+        enabled.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabled.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        enabled.descriptorBindingPartiallyBound = VK_TRUE;
+        enabled.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        enabled.shaderSampledImageArrayNonUniformIndexing = supported.shaderSampledImageArrayNonUniformIndexing;
+
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(_physicalDevice, &properties2);
+
+        descriptorIndexingEnabled = true;
+        nonUniformSamplerIndexingEnabled = supported.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+        maxUpdateAfterBindCombinedImageSamplers = std::min({
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+        maxPerStageUpdateAfterBindResources = indexingProperties.maxPerStageUpdateAfterBindResources;
+        return true;
+    }
+
+    bool SorpRenderDevice::hasDeviceExtension(VkPhysicalDevice device, const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, extensionName) == 0) {
+                return true;
             }
         }
+        return false;
     }
 
     bool SorpRenderDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -336,7 +527,13 @@ namespace sorp_v {
                 indices.graphicsFamilyHasValue = true;
             }
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+            if (_surface != VK_NULL_HANDLE) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+            }
+            else {
+                // Offscreen frames are "presented" by the graphics queue finishing them
+                presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            }
             if (queueFamily.queueCount > 0 && presentSupport) {
                 indices.presentFamily = i;
                 indices.presentFamilyHasValue = true;
@@ -377,6 +574,22 @@ namespace sorp_v {
         return details;
     }
 
+    VkFormat SorpRenderDevice::findDepthFormat() {
+        return findSupportedFormat(
+            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    }
+
+    bool SorpRenderDevice::supportsFormatFeatures(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &props);
+
+        VkFormatFeatureFlags supported =
+            tiling == VK_IMAGE_TILING_LINEAR ? props.linearTilingFeatures : props.optimalTilingFeatures;
+        return (supported & features) == features;
+    }
+
     VkFormat SorpRenderDevice::findSupportedFormat(
         const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
         for (VkFormat format : candidates) {
@@ -412,7 +625,7 @@ namespace sorp_v {
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory) {
+        SorpAllocation& bufferAllocation) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -426,16 +639,17 @@ namespace sorp_v {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(_device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        bufferAllocation = _allocator->allocate(
+            memRequirements, properties, SorpMemoryAllocator::ResourceKind::Linear);
 
-        if (vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
+        if (vkBindBufferMemory(_device, buffer, bufferAllocation.memory, bufferAllocation.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind buffer memory!");
         }
+    }
 
-        vkBindBufferMemory(_device, buffer, bufferMemory, 0);
+    void SorpRenderDevice::destroyBuffer(VkBuffer buffer, SorpAllocation& bufferAllocation) {
+        vkDestroyBuffer(_device, buffer, nullptr);
+        _allocator->free(bufferAllocation);
     }
 
     VkCommandBuffer SorpRenderDevice::beginSingleTimeCommands() {
@@ -513,7 +727,7 @@ namespace sorp_v {
         const VkImageCreateInfo& imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory) {
+        SorpAllocation& imageAllocation) {
         if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
         }
@@ -521,20 +735,81 @@ namespace sorp_v {
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(_device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        // large images (render targets, big textures) get their own allocation
+        auto kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL
+            ? SorpMemoryAllocator::ResourceKind::Optimal
+            : SorpMemoryAllocator::ResourceKind::Linear;
+        uint32_t memoryTypeIndex = _allocator->findMemoryType(memRequirements.memoryTypeBits, properties);
+        bool preferDedicated = memRequirements.size >= _allocator->blockSize(memoryTypeIndex) / 4;
 
-        if (vkAllocateMemory(_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+        imageAllocation = _allocator->allocate(memRequirements, properties, kind, preferDedicated);
 
-        if (vkBindImageMemory(_device, image, imageMemory, 0) != VK_SUCCESS) {
+        if (vkBindImageMemory(_device, image, imageAllocation.memory, imageAllocation.offset) != VK_SUCCESS) {
             throw std::runtime_error("failed to bind image memory!");
         }
     }
 
+    void SorpRenderDevice::destroyImage(VkImage image, SorpAllocation& imageAllocation) {
+        vkDestroyImage(_device, image, nullptr);
+        _allocator->free(imageAllocation);
+    }
+
+    void SorpRenderDevice::deferDestroy(std::function<void()> destroy, uint32_t extraFrames) {
+        std::lock_guard<std::mutex> lock(_deletionMutex);
+        _deletionQueue.push_back({ _frameNumber + extraFrames, std::move(destroy) });
+    }
+
+    void SorpRenderDevice::deferDestroyBuffer(VkBuffer buffer, SorpAllocation& bufferAllocation) {
+        SorpAllocation allocation = bufferAllocation;
+        bufferAllocation = SorpAllocation{};
+        deferDestroy([this, buffer, allocation]() mutable { destroyBuffer(buffer, allocation); });
+    }
+
+    void SorpRenderDevice::deferDestroyImage(VkImage image, SorpAllocation& imageAllocation) {
+        SorpAllocation allocation = imageAllocation;
+        imageAllocation = SorpAllocation{};
+        deferDestroy([this, image, allocation]() mutable { destroyImage(image, allocation); });
+    }
+
+    void SorpRenderDevice::collectDeletions(uint64_t completedFrame) {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(_deletionMutex);
+            // Entries are pushed in frame order apart from the extraFrames ones, so scan the whole queue
+            for (auto it = _deletionQueue.begin(); it != _deletionQueue.end();) {
+                if (it->frame <= completedFrame) {
+                    ready.push_back(std::move(it->destroy));
+                    it = _deletionQueue.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        // Run outside the lock, destroying an object may enqueue more work
+        for (auto& destroy : ready) {
+            destroy();
+        }
+    }
+
+    void SorpRenderDevice::flushDeletions() {
+        vkDeviceWaitIdle(_device);
+        while (true) {
+            std::deque<PendingDeletion> pending;
+            {
+                std::lock_guard<std::mutex> lock(_deletionMutex);
+                pending.swap(_deletionQueue);
+            }
+            if (pending.empty()) {
+                break;
+            }
+            for (auto& deletion : pending) {
+                deletion.destroy();
+            }
+        }
+    }
+
     void SorpRenderDevice::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
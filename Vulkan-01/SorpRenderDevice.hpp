@@ -1,12 +1,19 @@
 #pragma once
 
 #include "SorpWindow.hpp"
+#include "SorpMemoryAllocator.hpp"
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace sorp_v {
 
+    class SorpUploadQueue;
+
     struct SwapChainSupportDetails {
         VkSurfaceCapabilitiesKHR capabilities;
         std::vector<VkSurfaceFormatKHR> formats;
@@ -29,7 +36,9 @@ namespace sorp_v {
         const bool enableValidationLayers = true;
 #endif
 
-        SorpRenderDevice(SorpWindow& window);
+        // Without a window there is no surface unless headlessSurface asks for VK_EXT_headless_surface, without
+        // any surface nothing can be presented and rendering has to go to an offscreen target
+        SorpRenderDevice(SorpWindow* window, bool headlessSurface = false);
         ~SorpRenderDevice();
 
         // Not copyable or movable
@@ -41,14 +50,20 @@ namespace sorp_v {
         VkCommandPool getCommandPool() { return _commandPool; }
         VkDevice device() { return _device; }
         VkSurfaceKHR surface() { return _surface; }
+        bool hasSurface() const { return _surface != VK_NULL_HANDLE; }
         VkQueue graphicsQueue() { return _graphicsQueue; }
         VkQueue presentQueue() { return _presentQueue; }
+        SorpMemoryAllocator& allocator() { return *_allocator; }
+        SorpUploadQueue& uploadQueue() { return *_uploadQueue; }
+        VkPipelineCache pipelineCache() { return _pipelineCache; }
 
         SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(_physicalDevice); }
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
         QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(_physicalDevice); }
         VkFormat findSupportedFormat(
             const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+        VkFormat findDepthFormat();
+        bool supportsFormatFeatures(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
 
         // Buffer Helper Functions
         void createBuffer(
@@ -56,7 +71,8 @@ namespace sorp_v {
             VkBufferUsageFlags usage,
             VkMemoryPropertyFlags properties,
             VkBuffer& buffer,
-            VkDeviceMemory& bufferMemory);
+            SorpAllocation& bufferAllocation);
+        void destroyBuffer(VkBuffer buffer, SorpAllocation& bufferAllocation);
         VkCommandBuffer beginSingleTimeCommands();
         void endSingleTimeCommands(VkCommandBuffer commandBuffer);
         void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -67,10 +83,35 @@ namespace sorp_v {
             const VkImageCreateInfo& imageInfo,
             VkMemoryPropertyFlags properties,
             VkImage& image,
-            VkDeviceMemory& imageMemory);
+            SorpAllocation& imageAllocation);
+        void destroyImage(VkImage image, SorpAllocation& imageAllocation);
         void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 
+        // Deferred deletion: work enqueued during frame N runs once frame N (plus extraFrames) is known to be
+        // complete on the GPU, so resources can be released without vkDeviceWaitIdle
+        void deferDestroy(std::function<void()> destroy, uint32_t extraFrames = 0);
+        void deferDestroyBuffer(VkBuffer buffer, SorpAllocation& bufferAllocation);
+        void deferDestroyImage(VkImage image, SorpAllocation& imageAllocation);
+        uint64_t frameNumber() const { return _frameNumber; }
+        // Called once per submitted frame
+        void endFrame() { _frameNumber++; }
+        // Called after the fence of completedFrame has been waited on
+        void collectDeletions(uint64_t completedFrame);
+        // Waits for the device to go idle and runs everything still queued
+        void flushDeletions();
+
         VkPhysicalDeviceProperties properties;
+        // Optional features actually enabled on the logical device
+        VkPhysicalDeviceFeatures enabledFeatures = {};
+        // VK_EXT_descriptor_indexing with update after bind, partially bound and variable count bindings
+        bool descriptorIndexingEnabled = false;
+        // shaderSampledImageArrayNonUniformIndexing, only ever set along with descriptorIndexingEnabled
+        bool nonUniformSamplerIndexingEnabled = false;
+        // Combined image samplers count as both a sampler and a sampled image, this is the tighter of the two
+        uint32_t maxUpdateAfterBindCombinedImageSamplers = 0;
+        uint32_t maxPerStageUpdateAfterBindResources = 0;
+        // Of the graphics queue family, 0 means it can't write timestamps
+        uint32_t timestampValidBits = 0;
 
     private:
         void createInstance();
@@ -79,6 +120,10 @@ namespace sorp_v {
         void pickPhysicalDevice();
         void createLogicalDevice();
         void createCommandPool();
+        void createAllocator();
+        void createUploadQueue();
+        void createPipelineCache();
+        void savePipelineCache();
 
         // helper functions
         bool isDeviceSuitable(VkPhysicalDevice device);
@@ -88,21 +133,36 @@ namespace sorp_v {
         void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
         void hasGflwRequiredInstanceExtensions();
         bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+        bool hasDeviceExtension(VkPhysicalDevice device, const char* extensionName);
+        bool queryDescriptorIndexing(VkPhysicalDeviceDescriptorIndexingFeaturesEXT& enabled);
         SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
         VkInstance _instance;
         VkDebugUtilsMessengerEXT _debugMessenger;
         VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
-        SorpWindow& _window;
+        SorpWindow* _window;
+        bool _headlessSurface;
         VkCommandPool _commandPool;
 
         VkDevice _device;
-        VkSurfaceKHR _surface;
+        VkSurfaceKHR _surface = VK_NULL_HANDLE;
         VkQueue _graphicsQueue;
         VkQueue _presentQueue;
-
+        std::unique_ptr<SorpMemoryAllocator> _allocator;
+        std::unique_ptr<SorpUploadQueue> _uploadQueue;
+        VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+
+        struct PendingDeletion {
+            uint64_t frame;
+            std::function<void()> destroy;
+        };
+        std::mutex _deletionMutex;
+        std::deque<PendingDeletion> _deletionQueue;
+        uint64_t _frameNumber = 0;
+
+        const std::string PIPELINE_CACHE_FILE = "pipeline_cache.bin";
         const std::vector<const char*> _validationLayers = { "VK_LAYER_KHRONOS_validation" };
-        const std::vector<const char*> _deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+        std::vector<const char*> _deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     };
 
 }
\ No newline at end of file
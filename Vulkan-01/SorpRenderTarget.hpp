@@ -0,0 +1,23 @@
+#pragma once
+
+#include "SorpFrameContext.hpp"
+
+namespace sorp_v
+{
+	// What a frame renders into: the swap chain when presenting, an offscreen image set when headless
+	class SorpRenderTarget
+	{
+	public:
+		virtual ~SorpRenderTarget() = default;
+
+		virtual VkRenderPass renderPass() = 0;
+		virtual VkFramebuffer frameBuffer(uint32_t imageIndex) = 0;
+		virtual VkExtent2D extent() = 0;
+		virtual VkFormat colorFormat() = 0;
+
+		// The frame's fence has to be waited on already (SorpFrameRing::beginFrame)
+		virtual VkResult acquireNextImage(const SorpFrameContext& frame, uint32_t* imageIndex) = 0;
+		// Submits the frame's command buffer signaling frame.inFlightFence
+		virtual VkResult submitCommandBuffers(const SorpFrameContext& frame, uint32_t* imageIndex) = 0;
+	};
+}
@@ -2,63 +2,157 @@
 
 #include <stdexcept>
 #include <array>
+#include <cmath>
+#include <string>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+
+#include "SorpUploadQueue.hpp"
 
 namespace sorp_v
 {
-	const std::string SorpSimpleApp::VERTEX_SHADER = "shaders\\compiled\\simple_shader.vert.spv";
-	const std::string SorpSimpleApp::FRAGMENT_SHADER = "shaders\\compiled\\simple_shader.frag.spv";
-	const std::string SorpSimpleApp::DEFAULT_TEXTURE = "textures\\0.jpg";
+	namespace
+	{
+		// Squares of squareSize alternating between the color and half of it
+		std::vector<uint8_t> checkerboard(uint32_t size, uint32_t squareSize, uint8_t r, uint8_t g, uint8_t b)
+		{
+			std::vector<uint8_t> pixels(size * size * 4);
+			for (uint32_t y = 0; y < size; y++)
+			{
+				for (uint32_t x = 0; x < size; x++)
+				{
+					bool dark = ((x / squareSize) + (y / squareSize)) % 2 == 0;
+					uint8_t* pixel = &pixels[(y * size + x) * 4];
+					pixel[0] = dark ? r / 2 : r;
+					pixel[1] = dark ? g / 2 : g;
+					pixel[2] = dark ? b / 2 : b;
+					pixel[3] = 255;
+				}
+			}
+			return pixels;
+		}
+	}
 
-	SorpSimpleApp::SorpSimpleApp()
+	const std::string SorpSimpleApp::VERTEX_SHADER = "shaders/compiled/simple_shader.vert.spv";
+	const std::string SorpSimpleApp::FRAGMENT_SHADER = "shaders/compiled/simple_shader.frag.spv";
+	const std::string SorpSimpleApp::FRAGMENT_SHADER_NONUNIFORM = "shaders/compiled/simple_shader.nonuniform.frag.spv";
+	const std::string SorpSimpleApp::CULL_SHADER = "shaders/compiled/cull.comp.spv";
+	const std::string SorpSimpleApp::DEFAULT_TEXTURE = "textures/0.jpg";
+
+	SorpSimpleApp::SorpSimpleApp(const SorpAppSettings& settings) :
+		_sorpWindow{settings.headless ? nullptr : std::make_unique<SorpWindow>(WIDTH, HEIGHT, "SorpSimpleApp")},
+		_renderDevice{_sorpWindow.get(), settings.headless && settings.headlessSurface},
+		_frameLimit{settings.headless && settings.frameLimit == 0 ? DEFAULT_HEADLESS_FRAMES : settings.frameLimit},
+		_tracePath{settings.tracePath}
 	{
+		SorpCpuProfiler::setThreadName("main");
+		_frameRing = std::make_unique<SorpFrameRing>(_renderDevice, settings.framesInFlight);
+
+		_textureLoader = std::make_unique<SorpTextureLoader>(_renderDevice, _jobSystem);
 		createTextureImage();
 		createTextureImageView();
 		createTextureSampler();
-		
-		loadModels();
-		createUniformBuffers();
+		_bindlessTable = std::make_unique<SorpBindlessTable>(_renderDevice, _textureImageView, _textureSampler,
+			_frameRing->framesInFlight(), RESERVED_FRAGMENT_RESOURCES);
+		_geometryArena = std::make_unique<SorpGeometryArena>(_renderDevice, sizeof(SorpModel::Vertex));
+		createPlaceholderMesh();
+		_assets = std::make_unique<SorpAssetManager>(_renderDevice, _jobSystem, *_textureLoader, *_bindlessTable,
+			*_geometryArena, _textureSampler, *_placeholderMesh);
+
+		// Streamed, the first frames render with the placeholders
+		_defaultTexture = _assets->requestTexture(_sorpPathResolver.resolve(DEFAULT_TEXTURE));
+		loadModels(settings.modelCount);
+		createInstances(settings.instancesPerModel);
+		createSceneTextures(settings.textureCount);
 		createDescriptorSetLayout();
-		createPipelineLayout();
-		createDescriptorPool();
-		createDescriptorSets();
-		recreateSwapChain();
-		createCommandBuffers();
+		createFrameSetTemplate();
+		recreateRenderTarget();
+		_parallelRecorder = std::make_unique<SorpParallelRecorder>(_renderDevice, _jobSystem, _frameRing->framesInFlight(),
+			settings.minDrawsPerThread);
+		_gpuProfiler = std::make_unique<SorpGpuProfiler>(_renderDevice, _frameRing->framesInFlight(), settings.pipelineStatistics);
+
+		_renderDevice.uploadQueue().flush();
 	}
 
 	SorpSimpleApp::~SorpSimpleApp() 
 	{
-		vkDestroySampler(_renderDevice.device(), _textureSampler, nullptr);
-		vkDestroyImageView(_renderDevice.device(), _textureImageView, nullptr);
-		vkDestroyImage(_renderDevice.device(), _textureImage, nullptr);
-		vkFreeMemory(_renderDevice.device(), _textureImageMemory, nullptr);
-
+		// Deferred model frees point into the geometry arena, run them while the arena is still alive
+		_assets.reset();
+		_placeholderMesh.reset();
+		_renderDevice.flushDeletions();
+
+		VkDevice device = _renderDevice.device();
+		VkSampler textureSampler = _textureSampler;
+		VkImageView textureImageView = _textureImageView;
+		VkDescriptorSetLayout descriptorSetLayout = _descriptorSetLayout;
+		_renderDevice.deferDestroy([device, textureSampler, textureImageView, descriptorSetLayout]()
+		{
+			vkDestroySampler(device, textureSampler, nullptr);
+			vkDestroyImageView(device, textureImageView, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		});
+		_textureLoader->destroy(_texture);
 
-		for (size_t i = 0; i < _uniformBuffers.size(); i++) {
-			vkDestroyBuffer(_renderDevice.device(), _uniformBuffers[i], nullptr);
-			vkFreeMemory(_renderDevice.device(), _uniformBuffersMemory[i], nullptr);
+		for (auto& texture : _sceneTextures)
+		{
+			VkImageView view = texture.view;
+			_renderDevice.deferDestroy([device, view]() { vkDestroyImageView(device, view, nullptr); });
+			_textureLoader->destroy(texture.texture);
 		}
-		vkDestroyDescriptorPool(_renderDevice.device(), _descriptorPool, nullptr);
-		vkDestroyDescriptorSetLayout(_renderDevice.device(), _descriptorSetLayout, nullptr);
-		vkDestroyPipelineLayout(_renderDevice.device(), _pipelineLayout, nullptr);
 	}
 
 	void SorpSimpleApp::run()
 	{
-		while (!_sorpWindow.shouldClose())
+		uint32_t frameCount = 0;
+		while ((!_sorpWindow || !_sorpWindow->shouldClose()) && (_frameLimit == 0 || frameCount < _frameLimit))
 		{
-			glfwPollEvents();
+			if (_sorpWindow)
+			{
+				glfwPollEvents();
+			}
 			drawFrame();
+			frameCount++;
+
+			if (_sorpWindow && _sorpWindow->wasKeyPressed(CAPTURE_KEY))
+			{
+				writeCapture("sorp_trace_" + std::to_string(_captureCount++) + ".json");
+			}
 		}
 
 		vkDeviceWaitIdle(_renderDevice.device());
+		if (!_tracePath.empty())
+		{
+			writeCapture(_tracePath);
+		}
 	}
 
-	void SorpSimpleApp::loadModels()
+	std::vector<SorpFrameStats> SorpSimpleApp::runFrames(uint32_t frameCount)
 	{
-		std::vector<SorpModel::Vertex> vertices = {
+		std::vector<SorpFrameStats> stats;
+		stats.reserve(frameCount);
+		for (uint32_t i = 0; i < frameCount; i++)
+		{
+			if (_sorpWindow)
+			{
+				glfwPollEvents();
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			drawFrame();
+			double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			stats.push_back({ cpuMs, _gpuProfiler->frameGpuMs(), _gpuProfiler->hasFreshResults() });
+		}
+
+		vkDeviceWaitIdle(_renderDevice.device());
+		return stats;
+	}
+
+	void SorpSimpleApp::cubeMesh(std::vector<SorpModel::Vertex>& vertices, std::vector<uint16_t>& indexes)
+	{
+		vertices = {
 			{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
 			{{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
 			{{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
@@ -70,7 +164,7 @@ namespace sorp_v
 			{{-0.5f, 0.5f, 0.5}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
 		};
 
-		std::vector<uint16_t> indexes = {
+		indexes = {
 			4, 5, 6, 6, 7, 4,
 			0, 2, 1, 2, 0, 3,
 			0, 5, 4, 0, 1, 5,
@@ -78,27 +172,117 @@ namespace sorp_v
 			3, 6, 2, 3, 7, 6,
 			0, 4, 7, 0, 7, 3
 		};
+	}
+
+	void SorpSimpleApp::createPlaceholderMesh()
+	{
+		std::vector<SorpModel::Vertex> vertices;
+		std::vector<uint16_t> indexes;
+		cubeMesh(vertices, indexes);
+		_placeholderMesh = std::make_unique<SorpModel>(*_geometryArena, vertices, indexes);
+	}
 
-		_sorpModel = std::make_unique<SorpModel>(_renderDevice, vertices, indexes);
+	void SorpSimpleApp::loadModels(uint32_t modelCount)
+	{
+		// Separate copies on purpose, every model becomes its own draw. Generated until there is a mesh format.
+		for (uint32_t i = 0; i < std::max(modelCount, 1u); i++)
+		{
+			_meshes.push_back(_assets->requestMesh(cubeMesh));
+		}
+	}
+
+	void SorpSimpleApp::createInstances(uint32_t instancesPerModel)
+	{
+		if (_meshes.size() > SorpGpuCuller::MAX_DRAWS)
+		{
+			throw std::runtime_error("scene has more models than the culler has draw slots!");
+		}
+
+		const uint32_t objectCount = static_cast<uint32_t>(_meshes.size()) * instancesPerModel;
+		const uint32_t gridSize = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount)))));
+		const float start = -INSTANCE_SPACING * (gridSize - 1) * 0.5f;
+
+		_gpuCuller = std::make_unique<SorpGpuCuller>(_renderDevice, _sorpPathResolver.resolve(CULL_SHADER), objectCount,
+			_frameRing->framesInFlight());
+		for (auto mesh : _meshes)
+		{
+			_gpuCuller->addDraw(_assets->mesh(mesh), instancesPerModel);
+		}
+
+		// Models are interleaved over the grid so every draw has visible instances. Bounding spheres are filled
+		// in by refreshDrawAssets once the meshes are known.
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			uint32_t x = i % gridSize;
+			uint32_t y = i / gridSize;
+			float gridScale = gridSize > 1 ? 1.0f / (gridSize - 1) : 0.0f;
+
+			SorpGpuCuller::ObjectData object{};
+			object.instance.model = glm::translate(glm::mat4(1.0f),
+				glm::vec3(start + x * INSTANCE_SPACING, start + y * INSTANCE_SPACING, 0.0f));
+			object.instance.color = glm::vec4(0.5f + 0.5f * x * gridScale, 0.5f + 0.5f * y * gridScale, 1.0f, 1.0f);
+			object.drawIndex = i % static_cast<uint32_t>(_meshes.size());
+			_objects.push_back(object);
+		}
+	}
+
+	void SorpSimpleApp::createSceneTextures(uint32_t textureCount)
+	{
+		// The fallback table holds only a handful of textures
+		textureCount = std::min(std::max(textureCount, 1u), _bindlessTable->capacity());
+
+		for (uint32_t i = 1; i < textureCount; i++)
+		{
+			// Tinted by the texture index so different textures are told apart on screen
+			std::vector<uint8_t> pixels = checkerboard(GENERATED_TEXTURE_SIZE, 32, static_cast<uint8_t>(64 + (i * 97) % 192),
+				static_cast<uint8_t>(64 + (i * 57) % 192), static_cast<uint8_t>(64 + (i * 31) % 192));
+
+			SceneTexture texture{};
+			texture.texture = _textureLoader->upload(pixels.data(), GENERATED_TEXTURE_SIZE, GENERATED_TEXTURE_SIZE);
+			texture.view = createImageView(texture.texture.image, texture.texture.format, texture.texture.mipLevels);
+			texture.slot = _bindlessTable->registerTexture(texture.view, _textureSampler);
+			_sceneTextures.push_back(texture);
+		}
+
+		_drawMaterials.resize(_gpuCuller->drawCount());
+		refreshDrawAssets();
+	}
+
+	void SorpSimpleApp::refreshDrawAssets()
+	{
+		uint32_t materialCount = textureCount();
+		for (uint32_t draw = 0; draw < _gpuCuller->drawCount(); draw++)
+		{
+			uint32_t material = draw % materialCount;
+			_drawMaterials[draw] = material == 0 ? _assets->textureSlot(_defaultTexture) : _sceneTextures[material - 1].slot;
+			_gpuCuller->setDrawModel(draw, _assets->mesh(_meshes[draw]));
+			_gpuCuller->setDrawMaterial(draw, _drawMaterials[draw]);
+		}
+
+		for (auto& object : _objects)
+		{
+			object.instance.materialIndex = _drawMaterials[object.drawIndex];
+			glm::vec4 localSphere = _assets->mesh(_meshes[object.drawIndex]).boundingSphere();
+			object.boundingSphere = glm::vec4(glm::vec3(object.instance.model * glm::vec4(glm::vec3(localSphere), 1.0f)), localSphere.w);
+		}
+	}
+
+	void SorpSimpleApp::updateInstances(uint32_t frameIndex)
+	{
+		_gpuCuller->writeObjects(frameIndex, _objects);
 	}
 
 	void SorpSimpleApp::createDescriptorSetLayout()
 	{
 		VkDescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.descriptorCount = 1;
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		uboLayoutBinding.pImmutableSamplers = nullptr;
 
-		VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorCount = 1;
-		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerLayoutBinding.pImmutableSamplers = nullptr;
-		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+		// Textures live in the bindless table at set 1
+		std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };
 
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -111,58 +295,72 @@ namespace sorp_v
 		}
 	}
 
-	void SorpSimpleApp::createPipelineLayout()
+	void SorpSimpleApp::createPipeline()
 	{
-		VkPipelineLayoutCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineInfo.setLayoutCount = 1;
-		pipelineInfo.pSetLayouts = &_descriptorSetLayout;
-		pipelineInfo.pushConstantRangeCount = 0;
-		pipelineInfo.pPushConstantRanges = nullptr;
-
-		if (vkCreatePipelineLayout(_renderDevice.device(), &pipelineInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
+		auto pipelineConfig = SorpPipeline::defaultPipelineConfiguration();
+		pipelineConfig.renderPass = _renderTarget->renderPass();
+		pipelineConfig.descriptorSetLayouts = { _descriptorSetLayout, _bindlessTable->layout() };
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+		pipelineConfig.pushConstantRanges = { pushConstantRange };
+
+		struct TextureSpecialization
 		{
-			throw std::runtime_error("Couldnt create pipeline layout");
-		}
-	}
+			uint32_t capacity;
+			VkBool32 dynamicIndexing;
+		};
+		TextureSpecialization textureSpecialization{ _bindlessTable->capacity(),
+			_bindlessTable->supportsDynamicIndexing() ? VK_TRUE : VK_FALSE };
+
+		std::array<VkSpecializationMapEntry, 2> specializationEntries{};
+		specializationEntries[0].constantID = 0;
+		specializationEntries[0].offset = offsetof(TextureSpecialization, capacity);
+		specializationEntries[0].size = sizeof(uint32_t);
+		specializationEntries[1].constantID = 1;
+		specializationEntries[1].offset = offsetof(TextureSpecialization, dynamicIndexing);
+		specializationEntries[1].size = sizeof(VkBool32);
+
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = sizeof(TextureSpecialization);
+		specializationInfo.pData = &textureSpecialization;
+		pipelineConfig.specializationInfo = &specializationInfo;
 
-	void SorpSimpleApp::createPipeline()
-	{
-		auto pipelineConfig = SorpPipeline::defaultPipelineConfiguration(_swapChain->width(), _swapChain->height());
-		pipelineConfig.renderPass = _swapChain->getRenderPass();
-		pipelineConfig.pipelineLayout = _pipelineLayout;
 		_sorpPipeline = std::make_unique<SorpPipeline>(
 			_renderDevice,
 			_sorpPathResolver.resolve(VERTEX_SHADER),
-			_sorpPathResolver.resolve(FRAGMENT_SHADER),
+			_sorpPathResolver.resolve(_bindlessTable->supportsNonUniformIndexing() ? FRAGMENT_SHADER_NONUNIFORM : FRAGMENT_SHADER),
 			pipelineConfig
 		);
 	}
 
-	void SorpSimpleApp::createCommandBuffers()
+	void SorpSimpleApp::drawFrame()
 	{
-		_commandBuffers.resize(_swapChain->imageCount());
-
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = _renderDevice.getCommandPool();
-		allocInfo.commandBufferCount = static_cast<uint32_t>(_commandBuffers.size());
-
-		if (vkAllocateCommandBuffers(_renderDevice.device(), &allocInfo, _commandBuffers.data()) != VK_SUCCESS)
+		SORP_PROFILE_SCOPE("drawFrame");
+		// Uploads queued since the last frame go out ahead of the frame that uses them
 		{
-			throw std::runtime_error("failled to allocate command buffer");
+			SORP_PROFILE_SCOPE("upload flush");
+			_renderDevice.uploadQueue().flush();
+		}
+		// Streamed assets only change here, between frames
+		if (_assets->update())
+		{
+			refreshDrawAssets();
 		}
-	}
 
-	void SorpSimpleApp::drawFrame()
-	{
+		SorpFrameContext& frame = _frameRing->beginFrame();
+		_bindlessTable->beginFrame(frame.index);
+
 		uint32_t imageIndex;
-		auto result = _swapChain->acquireNextImage(&imageIndex);
+		auto result = _renderTarget->acquireNextImage(frame, &imageIndex);
 
 		if(result == VK_ERROR_OUT_OF_DATE_KHR)
 		{
-			recreateSwapChain();
+			recreateRenderTarget();
 			return;
 		}
 
@@ -171,14 +369,22 @@ namespace sorp_v
 			throw std::runtime_error("failed to acquire swap chain image");
 		}
 
-		updateUniformBuffer(imageIndex);
-		recordCommandBuffer(imageIndex);
-		result = _swapChain->submitCommandBuffers(&_commandBuffers[imageIndex], &imageIndex);
+		updateUniformBuffer(frame);
+		writeFrameDescriptorSet(frame);
+		updateInstances(frame.index);
+		recordCommandBuffer(frame, imageIndex);
+		result = _renderTarget->submitCommandBuffers(frame, &imageIndex);
+		_frameRing->endFrame();
+		updateWindowTitle();
 
-		if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _sorpWindow.wasWindowResized())
+		bool resized = _sorpWindow && _sorpWindow->wasWindowResized();
+		if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resized)
 		{
-			_sorpWindow.resetWindowResizedFlag();
-			recreateSwapChain();
+			if (resized)
+			{
+				_sorpWindow->resetWindowResizedFlag();
+			}
+			recreateRenderTarget();
 			return;
 		}
 
@@ -187,38 +393,107 @@ namespace sorp_v
 		}
 	}
 
-	void SorpSimpleApp::recreateSwapChain()
+	void SorpSimpleApp::updateWindowTitle()
 	{
-		auto extent = _sorpWindow.getExtent();
+		auto now = std::chrono::high_resolution_clock::now();
+		if (!_sorpWindow || !_gpuProfiler->isEnabled() ||
+			std::chrono::duration<double>(now - _lastTitleUpdate).count() < TITLE_UPDATE_SECONDS)
+		{
+			return;
+		}
+		_lastTitleUpdate = now;
+
+		std::ostringstream title;
+		title << std::fixed << std::setprecision(2) << "SorpSimpleApp | gpu " << _gpuProfiler->frameGpuMs() << " ms";
+		for (const auto& scope : _gpuProfiler->results())
+		{
+			title << " | " << scope.name << " " << scope.gpuMs << " ms";
+			if (scope.hasStatistics)
+			{
+				title << " (" << scope.statistics[SorpGpuProfiler::INPUT_PRIMITIVES] << " prims, "
+					<< scope.statistics[SorpGpuProfiler::FRAGMENT_INVOCATIONS] << " frags)";
+			}
+		}
+		_sorpWindow->setTitle(title.str());
+	}
+
+	void SorpSimpleApp::writeCapture(const std::string& path)
+	{
+		SorpCpuProfiler::writeChromeTrace(path);
+		std::cout << "trace written to " << path << std::endl;
+	}
+
+	VkExtent2D SorpSimpleApp::targetExtent()
+	{
+		if (!_sorpWindow)
+		{
+			return { static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) };
+		}
+
+		auto extent = _sorpWindow->getExtent();
 		while (extent.width == 0 || extent.height == 0)
 		{
-			extent = _sorpWindow.getExtent();
+			extent = _sorpWindow->getExtent();
 			glfwWaitEvents();
 		}
+		return extent;
+	}
 
-		vkDeviceWaitIdle(_renderDevice.device());
-		_swapChain.reset(nullptr);
-		_swapChain = std::make_unique<SorpSwapChain>(_renderDevice, extent);
-		createPipeline();
+	void SorpSimpleApp::recreateRenderTarget()
+	{
+		auto extent = targetExtent();
+
+		if (!_renderDevice.hasSurface())
+		{
+			// Offscreen images never go out of date
+			_renderTarget = std::make_unique<SorpOffscreenTarget>(_renderDevice, extent, _frameRing->framesInFlight());
+		}
+		else if (_renderTarget)
+		{
+			// No device idle: the old chain is handed over as oldSwapchain and destroyed once its frames retired.
+			// The extra frames in flight cover presentation still holding its semaphores
+			std::shared_ptr<SorpRenderTarget> oldSwapChain = std::move(_renderTarget);
+			_renderTarget = std::make_unique<SorpSwapChain>(_renderDevice, extent, static_cast<SorpSwapChain*>(oldSwapChain.get()));
+			_renderDevice.deferDestroy([oldSwapChain]() mutable { oldSwapChain.reset(); }, _frameRing->framesInFlight());
+		}
+		else
+		{
+			_renderTarget = std::make_unique<SorpSwapChain>(_renderDevice, extent);
+		}
+
+		// The new render pass stays compatible with the pipeline unless the color format changed
+		if (!_sorpPipeline || _pipelineColorFormat != _renderTarget->colorFormat())
+		{
+			createPipeline();
+			_pipelineColorFormat = _renderTarget->colorFormat();
+		}
 	}
 
-	void SorpSimpleApp::recordCommandBuffer(int imageIndex)
+	void SorpSimpleApp::recordCommandBuffer(SorpFrameContext& frame, uint32_t imageIndex)
 	{
+		SORP_PROFILE_SCOPE("recordCommandBuffer");
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-		if (vkBeginCommandBuffer(_commandBuffers[imageIndex], &beginInfo) != VK_SUCCESS)
+		if (vkBeginCommandBuffer(frame.commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failled to begin recording command buffer: " + std::to_string(frame.index));
+		}
+
+		_gpuProfiler->beginFrame(frame.commandBuffer, frame.index);
 		{
-			throw std::runtime_error("failled to begin recording command buffer: " + imageIndex);
+			SorpGpuScope cullScope{ *_gpuProfiler, frame.commandBuffer, "cull" };
+			_gpuCuller->cull(frame.commandBuffer, frame.index, _viewProjection);
 		}
+		uint32_t mainPassScope = _gpuProfiler->beginScope(frame.commandBuffer, "main pass");
 
 		VkRenderPassBeginInfo renderPassBegin{};
 		renderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBegin.renderPass = _swapChain->getRenderPass();
-		renderPassBegin.framebuffer = _swapChain->getFrameBuffer(imageIndex);
+		renderPassBegin.renderPass = _renderTarget->renderPass();
+		renderPassBegin.framebuffer = _renderTarget->frameBuffer(imageIndex);
 
 		renderPassBegin.renderArea.offset = { 0, 0 };
-		renderPassBegin.renderArea.extent = _swapChain->getSwapChainExtent();
+		renderPassBegin.renderArea.extent = _renderTarget->extent();
 
 		std::array<VkClearValue, 2> clearColors{};
 		clearColors[0].color = { 0.1f, 0.1f, 0.1f, 1.0f };
@@ -226,229 +501,138 @@ namespace sorp_v
 		renderPassBegin.clearValueCount = static_cast<uint32_t>(clearColors.size());
 		renderPassBegin.pClearValues = clearColors.data();
 
-		vkCmdBeginRenderPass(_commandBuffers[imageIndex], &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-
-		_sorpPipeline->bind(_commandBuffers[imageIndex]);
-		_sorpModel->bind(_commandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(_commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-			_pipelineLayout, 0, 1, &_descriptorSets[imageIndex], 0, nullptr);
-
-		_sorpModel->draw(_commandBuffers[imageIndex]);
-
-		vkCmdEndRenderPass(_commandBuffers[imageIndex]);
-		if (vkEndCommandBuffer(_commandBuffers[imageIndex]) != VK_SUCCESS) {
+		vkCmdBeginRenderPass(frame.commandBuffer, &renderPassBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = _renderTarget->renderPass();
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = _renderTarget->frameBuffer(imageIndex);
+		inheritanceInfo.pipelineStatistics = _gpuProfiler->statisticsFlags();
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(_renderTarget->extent().width);
+		viewport.height = static_cast<float>(_renderTarget->extent().height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = _renderTarget->extent();
+
+		_parallelRecorder->beginFrame(frame.index);
+		_parallelRecorder->record(frame.commandBuffer, inheritanceInfo, _gpuCuller->drawCount(),
+			[&](VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)
+			{
+				_sorpPipeline->bind(commandBuffer);
+				// Dynamic state isn't inherited from the primary buffer
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				_geometryArena->bind(commandBuffer);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+					_sorpPipeline->pipelineLayout(), 0, 1, &_frameDescriptorSet, 1, &_frameUniformOffset);
+				_bindlessTable->bind(commandBuffer, _sorpPipeline->pipelineLayout(), 1, frame.index);
+
+				PushConstants push{};
+				push.model = _modelRotation;
+				vkCmdPushConstants(commandBuffer, _sorpPipeline->pipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &push);
+				// Nothing changes between the draws of a slice, one multi-draw where the device supports it. Without
+				// non-uniform indexing the texture index must not change within it, so it's split per material
+				_gpuCuller->draw(commandBuffer, frame.index, first, count, !_bindlessTable->supportsNonUniformIndexing());
+			});
+
+		vkCmdEndRenderPass(frame.commandBuffer);
+		_gpuProfiler->endScope(frame.commandBuffer, mainPassScope);
+		if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer");
 		}
 	}
 
-	void SorpSimpleApp::createDescriptorSets()
+	void SorpSimpleApp::createFrameSetTemplate()
 	{
-		std::vector<VkDescriptorSetLayout> layouts(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1, _descriptorSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = _descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		allocInfo.pSetLayouts = layouts.data();
-
-		_descriptorSets.resize(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		if (vkAllocateDescriptorSets(_renderDevice.device(), &allocInfo, _descriptorSets.data()) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("не вдалося виділити набори дескрипторів!");
-		}
-
-		for (size_t i = 0; i < SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1; i++) {
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = _uniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
-
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = _textureImageView;
-			imageInfo.sampler = _textureSampler;
-
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = _descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = _descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
-
-			vkUpdateDescriptorSets(_renderDevice.device(), static_cast<uint32_t>(descriptorWrites.size()), 
-				descriptorWrites.data(), 0, nullptr);
-
-			VkWriteDescriptorSet descriptorWrite{};
-			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrite.dstSet = _descriptorSets[i];
-			descriptorWrite.dstBinding = 0;
-			descriptorWrite.dstArrayElement = 0;
-			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrite.descriptorCount = 1;
-			descriptorWrite.pBufferInfo = &bufferInfo;
-			descriptorWrite.pImageInfo = nullptr;
-			descriptorWrite.pTexelBufferView = nullptr;
-			vkUpdateDescriptorSets(_renderDevice.device(), 1, &descriptorWrite, 0, nullptr);
-		}
+		VkDescriptorUpdateTemplateEntry uniformEntry{};
+		uniformEntry.dstBinding = 0;
+		uniformEntry.dstArrayElement = 0;
+		uniformEntry.descriptorCount = 1;
+		uniformEntry.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		uniformEntry.offset = 0;
+		uniformEntry.stride = sizeof(VkDescriptorBufferInfo);
+
+		_frameSetTemplate = std::make_unique<SorpDescriptorUpdateTemplate>(_renderDevice, _descriptorSetLayout,
+			std::vector<VkDescriptorUpdateTemplateEntry>{ uniformEntry });
 	}
 
-	void SorpSimpleApp::createUniformBuffers()
+	void SorpSimpleApp::writeFrameDescriptorSet(SorpFrameContext& frame)
 	{
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-		_uniformBuffers.resize(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		_uniformBuffersMemory.resize(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		_uniformBuffersMapped.resize(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		for (size_t i = 0; i < SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1; i++) {
-			_renderDevice.createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				_uniformBuffers[i], _uniformBuffersMemory[i]);
-			vkMapMemory(_renderDevice.device(), _uniformBuffersMemory[i], 0, bufferSize, 0,
-				&_uniformBuffersMapped[i]);
-		}
-	}
+		// Allocated fresh every frame, the frame's allocator recycles it once the frame comes around again
+		_frameDescriptorSet = frame.descriptorAllocator->allocate(_descriptorSetLayout);
 
-	void SorpSimpleApp::createDescriptorPool()
-	{
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(SorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1);
-
-		if (vkCreateDescriptorPool(_renderDevice.device(), &poolInfo, nullptr, &_descriptorPool) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("failed to create descriptor pool!");
-		}
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = _frameRing->uniformBuffer();
+		bufferInfo.offset = frame.uniformOffset;
+		bufferInfo.range = sizeof(UniformBufferObject);
+
+		_frameSetTemplate->update(_frameDescriptorSet, &bufferInfo);
 	}
 
-	void SorpSimpleApp::updateUniformBuffer(int imageIndex) {
+	void SorpSimpleApp::updateUniformBuffer(SorpFrameContext& frame) {
+		SORP_PROFILE_SCOPE("updateUniformBuffer");
 		static auto startTime = std::chrono::high_resolution_clock::now();
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float,
 			std::chrono::seconds::period>(currentTime - startTime).count();
 
-		auto swapChainExtent = _sorpWindow.getExtent();
+		auto swapChainExtent = _renderTarget->extent();
 
 		UniformBufferObject ubo{};
-		ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
+		_modelRotation = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
 			glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f,
+		ubo.view = glm::lookAt(glm::vec3(8.0f, 8.0f, 8.0f), glm::vec3(0.0f, 0.0f,
 			0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 		ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width /
-			(float)swapChainExtent.height, 0.1f, 10.0f);
+			(float)swapChainExtent.height, 0.1f, 50.0f);
 		ubo.proj[1][1] *= -1;
 		ubo.time = time;
-		memcpy(_uniformBuffersMapped[imageIndex], &ubo, sizeof(ubo));
+		_viewProjection = ubo.proj * ubo.view;
+
+		SorpUniformAllocation uniform = _frameRing->allocateUniform(frame, sizeof(ubo));
+		memcpy(uniform.mapped, &ubo, sizeof(ubo));
+		_frameUniformOffset = uniform.dynamicOffset;
 	}
 
 	void SorpSimpleApp::createTextureImage()
 	{
-		int width, height, channels;
-		stbi_uc* pixels = stbi_load(_sorpPathResolver.resolve(DEFAULT_TEXTURE).c_str(), &width, &height, &channels, STBI_rgb_alpha);
-		VkDeviceSize imageSize = width * height * 4;
-
-		if(!pixels)
-		{
-			throw std::runtime_error("failed to load texture image!");
-		}
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		_renderDevice.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer, stagingBufferMemory);
-		void* data;
-		vkMapMemory(_renderDevice.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(_renderDevice.device(), stagingBufferMemory);
-
-		stbi_image_free(pixels);
-		
-		createImage(static_cast<uint32_t>(width), static_cast<uint32_t>(height), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
-
-		_renderDevice.transitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		_renderDevice.copyBufferToImage(stagingBuffer, _textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1);
-		_renderDevice.transitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		vkDestroyBuffer(_renderDevice.device(), stagingBuffer, nullptr);
-		vkFreeMemory(_renderDevice.device(), stagingBufferMemory, nullptr);
+		// Placeholder until the real default texture streamed in, small enough to never delay the first frame
+		std::vector<uint8_t> pixels = checkerboard(PLACEHOLDER_TEXTURE_SIZE, PLACEHOLDER_TEXTURE_SIZE / 4, 160, 160, 160);
+		_texture = _textureLoader->upload(pixels.data(), PLACEHOLDER_TEXTURE_SIZE, PLACEHOLDER_TEXTURE_SIZE);
 	}
 
-	void SorpSimpleApp::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-		VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+	void SorpSimpleApp::createTextureImageView()
 	{
-		VkImageCreateInfo imageInfo{};
-		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.extent.width = width;
-		imageInfo.extent.height = height;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = 1;
-		imageInfo.format = format;
-		imageInfo.tiling = tiling;
-		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageInfo.usage = usage;
-		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageInfo.flags = 0;
-
-		if (vkCreateImage(_renderDevice.device(), &imageInfo, nullptr, &image) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create texture!");
-		}
-
-		VkMemoryRequirements memoryRequirements;
-		vkGetImageMemoryRequirements(_renderDevice.device(), image, &memoryRequirements);
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memoryRequirements.size;
-		allocInfo.memoryTypeIndex = _renderDevice.findMemoryType(memoryRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(_renderDevice.device(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate image memory!");
-		}
-
-		vkBindImageMemory(_renderDevice.device(), image, imageMemory, 0);
+		_textureImageView = createImageView(_texture.image, _texture.format, _texture.mipLevels);
 	}
 
-	void SorpSimpleApp::createTextureImageView()
+	VkImageView SorpSimpleApp::createImageView(VkImage image, VkFormat format, uint32_t mipLevels)
 	{
 		VkImageViewCreateInfo viewInfo{};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewInfo.image = _textureImage;
+		viewInfo.image = image;
 		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		viewInfo.format = format;
 		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.levelCount = mipLevels;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
 		viewInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(_renderDevice.device(), &viewInfo, nullptr, &_textureImageView) != VK_SUCCESS) {
+		VkImageView imageView;
+		if (vkCreateImageView(_renderDevice.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create texture image view!");
 		}
+		return imageView;
 	}
 
 	void SorpSimpleApp::createTextureSampler()
@@ -466,7 +650,7 @@ namespace sorp_v
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerInfo.mipLodBias = 0.0f;
 		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
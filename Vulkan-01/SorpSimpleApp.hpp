@@ -10,77 +10,174 @@
 #include "SorpPipeline.hpp"
 #include "SorpRenderDevice.hpp"
 #include "SorpSwapChain.hpp"
+#include "SorpOffscreenTarget.hpp"
+#include "SorpFrameContext.hpp"
+#include "SorpBindlessTable.hpp"
 #include "SorpModel.hpp"
+#include "SorpGpuCuller.hpp"
+#include "SorpParallelRecorder.hpp"
+#include "SorpGpuProfiler.hpp"
+#include "SorpCpuProfiler.hpp"
+#include "SorpTextureLoader.hpp"
+#include "SorpAssetManager.hpp"
 
 #include <memory>
 #include <vector>
 
 namespace sorp_v {
+	struct SorpAppSettings
+	{
+		uint32_t framesInFlight = SorpFrameRing::DEFAULT_FRAMES_IN_FLIGHT;
+		// Collect pipeline statistics next to the GPU timings
+		bool pipelineStatistics = false;
+		// Chrome trace written on exit when set, F12 writes one at any time
+		std::string tracePath;
+		// No window, frames go to an offscreen target unless headlessSurface presents to VK_EXT_headless_surface
+		bool headless = false;
+		bool headlessSurface = false;
+		// Frames to render before run() returns, 0 runs until the window closes
+		uint32_t frameLimit = 0;
+
+		// Synthetic scene: modelCount copies of the cube, each drawn instancesPerModel times, cycling through
+		// textureCount textures. The first texture is loaded from Content, the others are generated.
+		uint32_t modelCount = 1;
+		uint32_t instancesPerModel = 32 * 32;
+		uint32_t textureCount = 1;
+		// Smallest draw slice recorded on its own thread, 1 records every draw in parallel
+		uint32_t minDrawsPerThread = SorpParallelRecorder::DEFAULT_MIN_ITEMS_PER_THREAD;
+	};
+
+	struct SorpFrameStats
+	{
+		// Wall time of drawFrame, fence waits included
+		double cpuMs;
+		// Of the last frame the GPU profiler resolved, frames in flight behind
+		double gpuMs;
+		// False when no frame was resolved during this one and gpuMs repeats an earlier sample
+		bool gpuFresh;
+	};
+
 	class SorpSimpleApp
 	{
 	public:
+		// Per frame camera data, the model transform goes through PushConstants
 		struct UniformBufferObject {
-			glm::mat4 model;
 			glm::mat4 view;
 			glm::mat4 proj;
 			float time;
 			glm::vec3 _padding;
 		};
 
+		// Matches the push_constant block in simple_shader.vert
+		struct PushConstants {
+			glm::mat4 model;
+		};
+
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
+		static constexpr float INSTANCE_SPACING = 1.5f;
+		static constexpr uint32_t GENERATED_TEXTURE_SIZE = 256;
+		static constexpr uint32_t PLACEHOLDER_TEXTURE_SIZE = 16;
+		// Fragment stage resources next to the texture table: the color attachment, the frame set is vertex only
+		static constexpr uint32_t RESERVED_FRAGMENT_RESOURCES = 1;
+		static constexpr double TITLE_UPDATE_SECONDS = 0.5;
+		static constexpr int CAPTURE_KEY = GLFW_KEY_F12;
+		static constexpr uint32_t DEFAULT_HEADLESS_FRAMES = 1000;
 
 		static const std::string VERTEX_SHADER;
 		static const std::string FRAGMENT_SHADER;
+		static const std::string FRAGMENT_SHADER_NONUNIFORM;
+		static const std::string CULL_SHADER;
 		static const std::string DEFAULT_TEXTURE;
 
-		SorpSimpleApp();
+		SorpSimpleApp(const SorpAppSettings& settings = SorpAppSettings{});
 		~SorpSimpleApp();
 
 		SorpSimpleApp(const SorpSimpleApp&) = delete;
 		SorpSimpleApp& operator=(const SorpSimpleApp&) = delete;
 
 		void run();
+		// Renders frameCount frames regardless of the frame limit
+		std::vector<SorpFrameStats> runFrames(uint32_t frameCount);
+
+		SorpRenderDevice& renderDevice() { return _renderDevice; }
+		uint32_t drawCallsPerFrame() const { return _gpuCuller->drawCount(); }
+		uint32_t objectCount() const { return static_cast<uint32_t>(_objects.size()); }
+		uint32_t textureCount() const { return static_cast<uint32_t>(_sceneTextures.size()) + 1; }
+		uint32_t pendingAssets() const { return _assets->pendingCount(); }
+		bool hasGpuTimings() const { return _gpuProfiler->isEnabled(); }
 
 	private:
-		SorpWindow _sorpWindow{ WIDTH, HEIGHT, "SorpSimpleApp" };
+		// Null when headless
+		std::unique_ptr<SorpWindow> _sorpWindow;
 		SorpPathResolver _sorpPathResolver;
-		SorpRenderDevice _renderDevice{ _sorpWindow };
-		std::unique_ptr<SorpSwapChain> _swapChain;
+		SorpJobSystem _jobSystem;
+		SorpRenderDevice _renderDevice;
+		std::unique_ptr<SorpRenderTarget> _renderTarget;
+		uint32_t _frameLimit;
+		std::unique_ptr<SorpFrameRing> _frameRing;
+
 		std::unique_ptr<SorpPipeline> _sorpPipeline;
-		VkDescriptorPool _descriptorPool;
+		VkFormat _pipelineColorFormat = VK_FORMAT_UNDEFINED;
 		VkDescriptorSetLayout _descriptorSetLayout;
-		VkPipelineLayout _pipelineLayout;
-		std::vector<VkCommandBuffer> _commandBuffers;
-		std::unique_ptr<SorpModel> _sorpModel;
-
-		std::vector<VkBuffer> _uniformBuffers;
-		std::vector<VkDeviceMemory> _uniformBuffersMemory;
-		std::vector<void*> _uniformBuffersMapped;
-		
-		std::vector<VkDescriptorSet> _descriptorSets;
+		std::unique_ptr<SorpDescriptorUpdateTemplate> _frameSetTemplate;
+		std::unique_ptr<SorpBindlessTable> _bindlessTable;
+		std::unique_ptr<SorpGeometryArena> _geometryArena;
+		std::unique_ptr<SorpModel> _placeholderMesh;
+		std::unique_ptr<SorpAssetManager> _assets;
+		SorpAssetManager::TextureHandle _defaultTexture;
+		// One per draw
+		std::vector<SorpAssetManager::MeshHandle> _meshes;
+		std::unique_ptr<SorpGpuCuller> _gpuCuller;
+		std::unique_ptr<SorpParallelRecorder> _parallelRecorder;
+		std::unique_ptr<SorpGpuProfiler> _gpuProfiler;
+		std::chrono::high_resolution_clock::time_point _lastTitleUpdate;
+		std::string _tracePath;
+		uint32_t _captureCount = 0;
+		std::vector<SorpGpuCuller::ObjectData> _objects;
+		glm::mat4 _viewProjection{ 1.0f };
+		// Set 0 of the current frame and the dynamic offset of its UniformBufferObject
+		VkDescriptorSet _frameDescriptorSet = VK_NULL_HANDLE;
+		uint32_t _frameUniformOffset = 0;
+		glm::mat4 _modelRotation{ 1.0f };
 
-		VkImage _textureImage;
+		std::unique_ptr<SorpTextureLoader> _textureLoader;
+		SorpTextureLoader::Texture _texture;
 		VkImageView _textureImageView;
 		VkSampler _textureSampler;
-		VkDeviceMemory _textureImageMemory;
 
-		void loadModels();
+		struct SceneTexture
+		{
+			SorpTextureLoader::Texture texture;
+			VkImageView view;
+			uint32_t slot;
+		};
+		std::vector<SceneTexture> _sceneTextures;
+		// Bindless slot sampled by each draw
+		std::vector<uint32_t> _drawMaterials;
+
+		static void cubeMesh(std::vector<SorpModel::Vertex>& vertices, std::vector<uint16_t>& indexes);
+		void createPlaceholderMesh();
+		void loadModels(uint32_t modelCount);
+		void createInstances(uint32_t instancesPerModel);
+		void createSceneTextures(uint32_t textureCount);
+		// Points draws and culling bounds at whatever the asset handles currently resolve to
+		void refreshDrawAssets();
+		void updateInstances(uint32_t frameIndex);
 		void createDescriptorSetLayout();
-		void createPipelineLayout();
 		void createPipeline();
-		void createCommandBuffers();
 		void drawFrame();
-		void recreateSwapChain();
-		void recordCommandBuffer(int imageIndex);
-		void createUniformBuffers();
-		void createDescriptorSets();
-		void createDescriptorPool();
-		void updateUniformBuffer(int imageIndex);
+		void updateWindowTitle();
+		void writeCapture(const std::string& path);
+		void recreateRenderTarget();
+		VkExtent2D targetExtent();
+		void recordCommandBuffer(SorpFrameContext& frame, uint32_t imageIndex);
+		void createFrameSetTemplate();
+		void writeFrameDescriptorSet(SorpFrameContext& frame);
+		void updateUniformBuffer(SorpFrameContext& frame);
 		void createTextureImage();
 		void createTextureImageView();
-		void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
-			VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+		VkImageView createImageView(VkImage image, VkFormat format, uint32_t mipLevels);
 		void createTextureSampler();
 	};
 }
@@ -1,4 +1,5 @@
 #include "SorpSwapChain.hpp"
+#include "SorpCpuProfiler.hpp"
 
 // std
 #include <array>
@@ -11,8 +12,9 @@
 
 namespace sorp_v {
 
-    SorpSwapChain::SorpSwapChain(SorpRenderDevice& deviceRef, VkExtent2D extent)
-        : _device{ deviceRef }, _windowExtent{ extent } {
+    SorpSwapChain::SorpSwapChain(SorpRenderDevice& deviceRef, VkExtent2D extent, SorpSwapChain* previous)
+        : _device{ deviceRef }, _windowExtent{ extent },
+        _oldSwapChain{ previous != nullptr ? previous->_swapChain : VK_NULL_HANDLE } {
         createSwapChain();
         createImageViews();
         createRenderPass();
@@ -34,8 +36,7 @@ namespace sorp_v {
 
         for (int i = 0; i < _depthImages.size(); i++) {
             vkDestroyImageView(_device.device(), _depthImageViews[i], nullptr);
-            vkDestroyImage(_device.device(), _depthImages[i], nullptr);
-            vkFreeMemory(_device.device(), _depthImageMemorys[i], nullptr);
+            _device.destroyImage(_depthImages[i], _depthImageAllocations[i]);
         }
 
         for (auto framebuffer : _swapChainFramebuffers) {
@@ -45,26 +46,18 @@ namespace sorp_v {
         vkDestroyRenderPass(_device.device(), _renderPass, nullptr);
 
         // cleanup synchronization objects
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(_device.device(), _renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(_device.device(), _imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(_device.device(), _inFlightFences[i], nullptr);
+        for (auto semaphore : _renderFinishedSemaphores) {
+            vkDestroySemaphore(_device.device(), semaphore, nullptr);
         }
     }
 
-    VkResult SorpSwapChain::acquireNextImage(uint32_t* imageIndex) {
-        vkWaitForFences(
-            _device.device(),
-            1,
-            &_inFlightFences[_currentFrame],
-            VK_TRUE,
-            std::numeric_limits<uint64_t>::max());
-
+    VkResult SorpSwapChain::acquireNextImage(const SorpFrameContext& frame, uint32_t* imageIndex) {
+        SORP_PROFILE_SCOPE("acquireNextImage");
         VkResult result = vkAcquireNextImageKHR(
             _device.device(),
             _swapChain,
             std::numeric_limits<uint64_t>::max(),
-            _imageAvailableSemaphores[_currentFrame],  // must be a not signaled semaphore
+            frame.imageAvailableSemaphore,  // must be a not signaled semaphore
             VK_NULL_HANDLE,
             imageIndex);
 
@@ -72,30 +65,26 @@ namespace sorp_v {
     }
 
     VkResult SorpSwapChain::submitCommandBuffers(
-        const VkCommandBuffer* buffers, uint32_t* imageIndex) {
-        if (_imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-            vkWaitForFences(_device.device(), 1, &_imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-        }
-        _imagesInFlight[*imageIndex] = _inFlightFences[_currentFrame];
-
+        const SorpFrameContext& frame, uint32_t* imageIndex) {
+        SORP_PROFILE_SCOPE("submitCommandBuffers");
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = { _imageAvailableSemaphores[_currentFrame] };
+        VkSemaphore waitSemaphores[] = { frame.imageAvailableSemaphore };
         VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
 
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = buffers;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-        VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
+        VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[*imageIndex] };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        vkResetFences(_device.device(), 1, &_inFlightFences[_currentFrame]);
-        if (vkQueueSubmit(_device.graphicsQueue(), 1, &submitInfo, _inFlightFences[_currentFrame]) !=
+        vkResetFences(_device.device(), 1, &frame.inFlightFence);
+        if (vkQueueSubmit(_device.graphicsQueue(), 1, &submitInfo, frame.inFlightFence) !=
             VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
@@ -112,11 +101,8 @@ namespace sorp_v {
 
         presentInfo.pImageIndices = imageIndex;
 
-        auto result = vkQueuePresentKHR(_device.presentQueue(), &presentInfo);
-
-        _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
-        return result;
+        SORP_PROFILE_SCOPE("vkQueuePresentKHR");
+        return vkQueuePresentKHR(_device.presentQueue(), &presentInfo);
     }
 
     void SorpSwapChain::createSwapChain() {
@@ -163,7 +149,7 @@ namespace sorp_v {
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
 
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        createInfo.oldSwapchain = _oldSwapChain;
 
         if (vkCreateSwapchainKHR(_device.device(), &createInfo, nullptr, &_swapChain) != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
@@ -293,7 +279,7 @@ namespace sorp_v {
         VkExtent2D swapChainExtent = getSwapChainExtent();
 
         _depthImages.resize(imageCount());
-        _depthImageMemorys.resize(imageCount());
+        _depthImageAllocations.resize(imageCount());
         _depthImageViews.resize(imageCount());
 
         for (int i = 0; i < _depthImages.size(); i++) {
@@ -317,7 +303,7 @@ namespace sorp_v {
                 imageInfo,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                 _depthImages[i],
-                _depthImageMemorys[i]);
+                _depthImageAllocations[i]);
 
             VkImageViewCreateInfo viewInfo{};
             viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -337,24 +323,14 @@ namespace sorp_v {
     }
 
     void SorpSwapChain::createSyncObjects() {
-        _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        _renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        _inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-        _imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+        _renderFinishedSemaphores.resize(imageCount());
 
         VkSemaphoreCreateInfo semaphoreInfo = {};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fenceInfo = {};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(_device.device(), &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]) !=
-                VK_SUCCESS ||
-                vkCreateSemaphore(_device.device(), &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) !=
-                VK_SUCCESS ||
-                vkCreateFence(_device.device(), &fenceInfo, nullptr, &_inFlightFences[i]) != VK_SUCCESS) {
+        for (size_t i = 0; i < imageCount(); i++) {
+            if (vkCreateSemaphore(_device.device(), &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) !=
+                VK_SUCCESS) {
                 throw std::runtime_error("failed to create synchronization objects for a frame!");
             }
         }
@@ -410,10 +386,7 @@ namespace sorp_v {
     }
 
     VkFormat SorpSwapChain::findDepthFormat() {
-        return _device.findSupportedFormat(
-            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+        return _device.findDepthFormat();
     }
 
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "SorpRenderDevice.hpp"
+#include "SorpFrameContext.hpp"
+#include "SorpRenderTarget.hpp"
 
 #include <vulkan/vulkan.h>
 
@@ -8,12 +10,12 @@
 
 namespace sorp_v {
 
-    class SorpSwapChain {
+    class SorpSwapChain : public SorpRenderTarget {
     public:
-        static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-        SorpSwapChain(SorpRenderDevice& deviceRef, VkExtent2D windowExtent);
-        ~SorpSwapChain();
+        // previous is handed to the driver as oldSwapchain, it has to stay alive until the frames it
+        // presented have retired
+        SorpSwapChain(SorpRenderDevice& deviceRef, VkExtent2D windowExtent, SorpSwapChain* previous = nullptr);
+        ~SorpSwapChain() override;
 
         SorpSwapChain(const SorpSwapChain&) = delete;
         SorpSwapChain& operator=(const SorpSwapChain&) = delete;
@@ -32,8 +34,13 @@ namespace sorp_v {
         }
         VkFormat findDepthFormat();
 
-        VkResult acquireNextImage(uint32_t* imageIndex);
-        VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex);
+        VkRenderPass renderPass() override { return _renderPass; }
+        VkFramebuffer frameBuffer(uint32_t imageIndex) override { return _swapChainFramebuffers[imageIndex]; }
+        VkExtent2D extent() override { return _swapChainExtent; }
+        VkFormat colorFormat() override { return _swapChainImageFormat; }
+
+        VkResult acquireNextImage(const SorpFrameContext& frame, uint32_t* imageIndex) override;
+        VkResult submitCommandBuffers(const SorpFrameContext& frame, uint32_t* imageIndex) override;
 
     private:
         void createSwapChain();
@@ -57,7 +64,7 @@ namespace sorp_v {
         VkRenderPass _renderPass;
 
         std::vector<VkImage> _depthImages;
-        std::vector<VkDeviceMemory> _depthImageMemorys;
+        std::vector<SorpAllocation> _depthImageAllocations;
         std::vector<VkImageView> _depthImageViews;
         std::vector<VkImage> _swapChainImages;
         std::vector<VkImageView> _swapChainImageViews;
@@ -66,12 +73,10 @@ namespace sorp_v {
         VkExtent2D _windowExtent;
 
         VkSwapchainKHR _swapChain;
+        VkSwapchainKHR _oldSwapChain;
 
-        std::vector<VkSemaphore> _imageAvailableSemaphores;
+        // One per swap chain image: an image is only handed out again once its present went through
         std::vector<VkSemaphore> _renderFinishedSemaphores;
-        std::vector<VkFence> _inFlightFences;
-        std::vector<VkFence> _imagesInFlight;
-        size_t _currentFrame = 0;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "SorpTextureCooker.hpp"
+#include "SorpKtx2.hpp"
+#include "SorpMipGenerator.hpp"
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	namespace
+	{
+		constexpr uint32_t BLOCK_DIMENSION = 4;
+		constexpr uint32_t BLOCK_ROWS_PER_JOB = 16;
+
+		// Only sources that carry an alpha channel and actually use it pay for BC3's twice as large blocks
+		bool hasTranslucency(const uint8_t* pixels, uint32_t width, uint32_t height, int channels)
+		{
+			if (channels != 2 && channels != 4)
+			{
+				return false;
+			}
+
+			size_t texelCount = static_cast<size_t>(width) * height;
+			for (size_t i = 0; i < texelCount; i++)
+			{
+				if (pixels[i * SorpMipGenerator::BYTES_PER_PIXEL + 3] != 255)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void encodeLevel(SorpJobSystem& jobSystem, const uint8_t* pixels, uint32_t width, uint32_t height, VkFormat format,
+			uint8_t* blocks)
+		{
+			uint32_t blocksWide = (width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+			uint32_t blocksHigh = (height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+			uint32_t blockSize = SorpKtx2::blockSize(format);
+			// stb_dxt writes a BC3 block, explicit alpha followed by BC1 color, when asked to keep alpha
+			int alpha = format == VK_FORMAT_BC3_SRGB_BLOCK ? 1 : 0;
+
+			jobSystem.parallelFor(blocksHigh, BLOCK_ROWS_PER_JOB, [&](uint32_t first, uint32_t count)
+			{
+				uint8_t texels[BLOCK_DIMENSION * BLOCK_DIMENSION * SorpMipGenerator::BYTES_PER_PIXEL];
+				for (uint32_t by = first; by < first + count; by++)
+				{
+					for (uint32_t bx = 0; bx < blocksWide; bx++)
+					{
+						// Edge blocks of levels that aren't a multiple of 4 repeat the last row and column
+						for (uint32_t y = 0; y < BLOCK_DIMENSION; y++)
+						{
+							uint32_t sy = std::min(by * BLOCK_DIMENSION + y, height - 1);
+							for (uint32_t x = 0; x < BLOCK_DIMENSION; x++)
+							{
+								uint32_t sx = std::min(bx * BLOCK_DIMENSION + x, width - 1);
+								memcpy(&texels[(y * BLOCK_DIMENSION + x) * SorpMipGenerator::BYTES_PER_PIXEL],
+									&pixels[(static_cast<size_t>(sy) * width + sx) * SorpMipGenerator::BYTES_PER_PIXEL],
+									SorpMipGenerator::BYTES_PER_PIXEL);
+							}
+						}
+						stb_compress_dxt_block(blocks + (static_cast<size_t>(by) * blocksWide + bx) * blockSize, texels, alpha,
+							STB_DXT_HIGHQUAL);
+					}
+				}
+			});
+		}
+	}
+
+	void SorpTextureCooker::cook(SorpJobSystem& jobSystem, const std::string& sourcePath, const std::string& cookedPath)
+	{
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			throw std::runtime_error("failed to load texture to cook: " + sourcePath);
+		}
+
+		uint32_t levelCount = SorpMipGenerator::mipLevelCount(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		std::vector<uint8_t> chain(SorpMipGenerator::chainSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height), levelCount));
+		memcpy(chain.data(), pixels, static_cast<size_t>(width) * height * SorpMipGenerator::BYTES_PER_PIXEL);
+		stbi_image_free(pixels);
+		bool translucent = hasTranslucency(chain.data(), static_cast<uint32_t>(width), static_cast<uint32_t>(height), channels);
+
+		std::vector<VkBufferImageCopy> levels = SorpMipGenerator::generate(jobSystem, chain.data(),
+			static_cast<uint32_t>(width), static_cast<uint32_t>(height), levelCount);
+
+		// Opaque images keep all four BC1 colors for the image, BC1's punch through alpha would cost one of them and
+		// still turn soft edges into hard cutouts, so anything translucent goes to BC3
+		SorpKtx2::Texture texture{};
+		texture.format = translucent ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		texture.width = static_cast<uint32_t>(width);
+		texture.height = static_cast<uint32_t>(height);
+		for (const auto& level : levels)
+		{
+			uint32_t blocksWide = (level.imageExtent.width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+			uint32_t blocksHigh = (level.imageExtent.height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+
+			SorpKtx2::Level info{};
+			info.offset = texture.data.size();
+			info.size = static_cast<size_t>(blocksWide) * blocksHigh * SorpKtx2::blockSize(texture.format);
+			info.width = level.imageExtent.width;
+			info.height = level.imageExtent.height;
+			texture.levels.push_back(info);
+
+			texture.data.resize(info.offset + info.size);
+			encodeLevel(jobSystem, chain.data() + level.bufferOffset, info.width, info.height, texture.format,
+				texture.data.data() + info.offset);
+		}
+
+		SorpKtx2::write(cookedPath, texture);
+	}
+
+	uint32_t SorpTextureCooker::cookDirectory(SorpJobSystem& jobSystem, const std::string& directory, std::ostream& log)
+	{
+		uint32_t cooked = 0;
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			if (!entry.is_regular_file() || (extension != ".jpg" && extension != ".jpeg" && extension != ".png" && extension != ".tga"))
+			{
+				continue;
+			}
+
+			std::filesystem::path cookedPath = entry.path();
+			cookedPath.replace_extension(COOKED_EXTENSION);
+			cook(jobSystem, entry.path().string(), cookedPath.string());
+
+			log << entry.path().string() << " -> " << cookedPath.string() << " ("
+				<< std::filesystem::file_size(entry.path()) << " -> " << std::filesystem::file_size(cookedPath) << " bytes)\n";
+			cooked++;
+		}
+		return cooked;
+	}
+}
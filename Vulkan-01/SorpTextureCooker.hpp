@@ -0,0 +1,22 @@
+#pragma once
+
+#include "SorpJobSystem.hpp"
+
+#include <ostream>
+#include <string>
+
+namespace sorp_v
+{
+	// Offline conversion of source images into BC1 compressed KTX2 files with a full mip chain, or BC3 when the image
+	// has translucent texels, so the runtime uploads blocks straight from disk instead of decoding them into RGBA8.
+	class SorpTextureCooker
+	{
+	public:
+		static constexpr const char* COOKED_EXTENSION = ".ktx2";
+
+		// Mips are generated on the CPU and every level is encoded in parallel by block rows
+		static void cook(SorpJobSystem& jobSystem, const std::string& sourcePath, const std::string& cookedPath);
+		// Cooks every jpg, png and tga below directory next to its source. Returns the number of files written.
+		static uint32_t cookDirectory(SorpJobSystem& jobSystem, const std::string& directory, std::ostream& log);
+	};
+}
@@ -0,0 +1,202 @@
+#include "SorpTextureLoader.hpp"
+#include "SorpUploadQueue.hpp"
+#include "SorpTextureCooker.hpp"
+#include "SorpMipGenerator.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpTextureLoader::SorpTextureLoader(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem) :
+		_renderDevice{renderDevice}, _jobSystem{jobSystem}
+	{
+		_canBlitMips = _renderDevice.supportsFormatFeatures(DECODED_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+	}
+
+	std::vector<SorpTextureLoader::Texture> SorpTextureLoader::load(const std::vector<std::string>& paths)
+	{
+		SORP_PROFILE_SCOPE("load textures");
+
+		std::vector<Texture> textures(paths.size());
+		// Jobs must not throw, failures are carried back and rethrown here
+		std::vector<std::exception_ptr> errors(paths.size());
+
+		SorpJobCounter counter;
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			_jobSystem.run([this, &paths, &textures, &errors, i]()
+			{
+				try
+				{
+					textures[i] = loadFile(paths[i]);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}, &counter);
+		}
+		_jobSystem.wait(counter);
+
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			if (!errors[i])
+			{
+				continue;
+			}
+
+			for (auto& texture : textures)
+			{
+				destroy(texture);
+			}
+			std::rethrow_exception(errors[i]);
+		}
+		return textures;
+	}
+
+	SorpTextureLoader::Texture SorpTextureLoader::load(const std::string& path)
+	{
+		return load(std::vector<std::string>{ path })[0];
+	}
+
+	SorpTextureLoader::Texture SorpTextureLoader::loadFile(const std::string& path)
+	{
+		SORP_PROFILE_SCOPE("load texture");
+
+		// Cooked by --cook-textures, the blocks and mips go to the GPU as they are
+		std::filesystem::path cookedPath{ path };
+		cookedPath.replace_extension(SorpTextureCooker::COOKED_EXTENSION);
+		if (_renderDevice.enabledFeatures.textureCompressionBC && std::filesystem::exists(cookedPath))
+		{
+			return uploadCompressed(SorpKtx2::load(cookedPath.string()));
+		}
+
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			throw std::runtime_error("failed to load texture image: " + path);
+		}
+
+		Texture texture{};
+		try
+		{
+			texture = upload(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		}
+		catch (...)
+		{
+			stbi_image_free(pixels);
+			throw;
+		}
+		stbi_image_free(pixels);
+		return texture;
+	}
+
+	SorpTextureLoader::Texture SorpTextureLoader::upload(const void* pixels, uint32_t width, uint32_t height)
+	{
+		uint32_t mipLevels = SorpMipGenerator::mipLevelCount(width, height);
+		Texture texture = createImage(width, height, mipLevels, DECODED_FORMAT,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+		size_t levelSize = static_cast<size_t>(width) * height * SorpMipGenerator::BYTES_PER_PIXEL;
+		if (_canBlitMips)
+		{
+			// Layout transitions, the copy and the blits are batched with every other pending upload
+			_renderDevice.uploadQueue().uploadImage(texture.image, width, height, pixels, levelSize, mipLevels);
+			return texture;
+		}
+
+		// Built in regular memory, staging memory may be write combined and slow to read back from
+		std::vector<uint8_t> chain(SorpMipGenerator::chainSize(width, height, mipLevels));
+		memcpy(chain.data(), pixels, levelSize);
+		std::vector<VkBufferImageCopy> regions = SorpMipGenerator::generate(_jobSystem, chain.data(), width, height, mipLevels);
+
+		SorpUploadQueue::StagingRegion source = _renderDevice.uploadQueue().reserve(chain.size(), SorpMipGenerator::BYTES_PER_PIXEL);
+		memcpy(source.mapped, chain.data(), chain.size());
+		_renderDevice.uploadQueue().uploadImage(source, texture.image, regions, mipLevels);
+		return texture;
+	}
+
+	SorpTextureLoader::Texture SorpTextureLoader::uploadCompressed(const SorpKtx2::Texture& source)
+	{
+		uint32_t mipLevels = static_cast<uint32_t>(source.levels.size());
+		Texture texture = createImage(source.width, source.height, mipLevels, source.format,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+		size_t size = 0;
+		for (const auto& level : source.levels)
+		{
+			size += level.size;
+		}
+
+		// Levels are packed back to back, in the file they are stored smallest first
+		SorpUploadQueue::StagingRegion staging = _renderDevice.uploadQueue().reserve(size, SorpKtx2::blockSize(source.format));
+		std::vector<VkBufferImageCopy> regions;
+		VkDeviceSize offset = 0;
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			const SorpKtx2::Level& level = source.levels[i];
+			memcpy(static_cast<uint8_t*>(staging.mapped) + offset, source.data.data() + level.offset, level.size);
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = i;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { level.width, level.height, 1 };
+			regions.push_back(region);
+
+			offset += level.size;
+		}
+
+		_renderDevice.uploadQueue().uploadImage(staging, texture.image, regions, mipLevels);
+		return texture;
+	}
+
+	void SorpTextureLoader::destroy(Texture& texture)
+	{
+		if (texture.image != VK_NULL_HANDLE)
+		{
+			_renderDevice.deferDestroyImage(texture.image, texture.allocation);
+			texture.image = VK_NULL_HANDLE;
+		}
+	}
+
+	SorpTextureLoader::Texture SorpTextureLoader::createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
+		VkFormat format, VkImageUsageFlags usage)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = width;
+		imageInfo.extent.height = height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.flags = 0;
+
+		Texture texture{};
+		texture.format = format;
+		texture.width = width;
+		texture.height = height;
+		texture.mipLevels = mipLevels;
+		_renderDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.allocation);
+		return texture;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+#include "SorpJobSystem.hpp"
+#include "SorpKtx2.hpp"
+
+#include <string>
+#include <vector>
+
+namespace sorp_v
+{
+	// Turns image files into sampled images with a full mip chain. Files are read and decoded on the job system,
+	// each job writes its result straight into upload queue staging memory and queues the copy, so nothing but the
+	// final flush happens on the calling thread.
+	class SorpTextureLoader
+	{
+	public:
+		struct Texture
+		{
+			VkImage image = VK_NULL_HANDLE;
+			SorpAllocation allocation;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t mipLevels = 0;
+		};
+
+		static constexpr VkFormat DECODED_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+		SorpTextureLoader(SorpRenderDevice& renderDevice, SorpJobSystem& jobSystem);
+
+		SorpTextureLoader(const SorpTextureLoader&) = delete;
+		SorpTextureLoader& operator=(const SorpTextureLoader&) = delete;
+
+		// Prefers a cooked .ktx2 next to each path when the device samples BC formats. Blocks until every texture is
+		// queued on the upload queue, the caller flushes it. Throws the first failure once all jobs finished.
+		std::vector<Texture> load(const std::vector<std::string>& paths);
+		Texture load(const std::string& path);
+
+		// loadFile, upload and uploadCompressed are safe to call from any thread
+		Texture loadFile(const std::string& path);
+		// RGBA8 sRGB pixels, the rest of the chain is blitted on the GPU or generated on the CPU when the format
+		// can't be blitted with linear filtering
+		Texture upload(const void* pixels, uint32_t width, uint32_t height);
+		// Every level of an already block compressed texture as stored
+		Texture uploadCompressed(const SorpKtx2::Texture& source);
+
+		// Main thread only, the image is released once the current frame completed
+		void destroy(Texture& texture);
+
+	private:
+		SorpRenderDevice& _renderDevice;
+		SorpJobSystem& _jobSystem;
+		bool _canBlitMips;
+
+		Texture createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage);
+	};
+}
@@ -0,0 +1,513 @@
+#include "SorpUploadQueue.hpp"
+#include "SorpCpuProfiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace sorp_v
+{
+	SorpUploadQueue::SorpUploadQueue(SorpRenderDevice& renderDevice, VkDeviceSize ringSize) :
+		_renderDevice{renderDevice}, _ringSize{ringSize}
+	{
+		createCommandPool();
+
+		_renderDevice.createBuffer(_ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_ringBuffer, _ringAllocation);
+	}
+
+	SorpUploadQueue::~SorpUploadQueue()
+	{
+		waitIdle();
+
+		for (auto& reservation : _reservations)
+		{
+			if (reservation.standaloneBuffer != VK_NULL_HANDLE)
+			{
+				_renderDevice.destroyBuffer(reservation.standaloneBuffer, reservation.standaloneAllocation);
+			}
+		}
+
+		for (auto& batch : _freeBatches)
+		{
+			vkDestroyFence(_renderDevice.device(), batch.fence, nullptr);
+		}
+
+		_renderDevice.destroyBuffer(_ringBuffer, _ringAllocation);
+		vkDestroyCommandPool(_renderDevice.device(), _commandPool, nullptr);
+	}
+
+	SorpUploadQueue::StagingRegion::~StagingRegion()
+	{
+		if (_queue)
+		{
+			_queue->cancel(_id);
+		}
+	}
+
+	SorpUploadQueue::StagingRegion::StagingRegion(StagingRegion&& other) noexcept :
+		buffer{other.buffer}, offset{other.offset}, size{other.size}, mapped{other.mapped}, _queue{other._queue}, _id{other._id}
+	{
+		other._queue = nullptr;
+	}
+
+	SorpUploadQueue::StagingRegion& SorpUploadQueue::StagingRegion::operator=(StagingRegion&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (_queue)
+			{
+				_queue->cancel(_id);
+			}
+			buffer = other.buffer;
+			offset = other.offset;
+			size = other.size;
+			mapped = other.mapped;
+			_queue = other._queue;
+			_id = other._id;
+			other._queue = nullptr;
+		}
+		return *this;
+	}
+
+	SorpUploadQueue::StagingRegion SorpUploadQueue::reserve(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		retireCompletedBatches(false, 0);
+
+		alignment = std::max(alignment, _renderDevice.properties.limits.optimalBufferCopyOffsetAlignment);
+
+		if (_ringUsed == 0)
+		{
+			_ringHead = 0;
+		}
+
+		VkDeviceSize offset = (_ringHead + alignment - 1) / alignment * alignment;
+		VkDeviceSize padding = offset - _ringHead;
+		if (offset + size > _ringSize)
+		{
+			// Wrap around, the tail end of the ring is wasted until this reservation retires
+			offset = 0;
+			padding = _ringSize - _ringHead;
+		}
+
+		Reservation reservation{};
+		reservation.id = _nextReservationId++;
+
+		StagingRegion region{};
+		region._queue = this;
+		region._id = reservation.id;
+		region.size = size;
+
+		if (_ringUsed + padding + size <= _ringSize)
+		{
+			reservation.bytes = padding + size;
+			_ringUsed += reservation.bytes;
+			_ringHead = offset + size;
+
+			region.buffer = _ringBuffer;
+			region.offset = offset;
+			region.mapped = static_cast<char*>(_ringAllocation.mapped) + offset;
+		}
+		else
+		{
+			reservation.bytes = 0;
+			_renderDevice.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				reservation.standaloneBuffer, reservation.standaloneAllocation);
+
+			region.buffer = reservation.standaloneBuffer;
+			region.offset = 0;
+			region.mapped = reservation.standaloneAllocation.mapped;
+		}
+
+		_reservations.push_back(reservation);
+		return region;
+	}
+
+	void SorpUploadQueue::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+	{
+		StagingRegion source = reserve(size);
+		memcpy(source.mapped, data, static_cast<size_t>(size));
+		uploadBuffer(source, dstBuffer, dstOffset);
+	}
+
+	void SorpUploadQueue::uploadBuffer(const StagingRegion& source, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+	{
+		PendingBufferCopy copy{};
+		copy.srcBuffer = source.buffer;
+		copy.dstBuffer = dstBuffer;
+		copy.region.srcOffset = source.offset;
+		copy.region.dstOffset = dstOffset;
+		copy.region.size = source.size;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pendingBufferCopies.push_back(copy);
+		markRecorded(source._id);
+	}
+
+	void SorpUploadQueue::uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+		uint32_t mipLevels)
+	{
+		StagingRegion source = reserve(size);
+		memcpy(source.mapped, data, static_cast<size_t>(size));
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { width, height, 1 };
+
+		PendingImageCopy copy{};
+		copy.srcBuffer = source.buffer;
+		copy.image = image;
+		copy.regions = { region };
+		copy.regions[0].bufferOffset += source.offset;
+		copy.mipLevels = mipLevels;
+		copy.generateMips = mipLevels > 1;
+		copy.extent = { width, height };
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pendingImageCopies.push_back(std::move(copy));
+		markRecorded(source._id);
+	}
+
+	void SorpUploadQueue::uploadImage(const StagingRegion& source, VkImage image, const std::vector<VkBufferImageCopy>& regions, uint32_t mipLevels)
+	{
+		PendingImageCopy copy{};
+		copy.srcBuffer = source.buffer;
+		copy.image = image;
+		copy.regions = regions;
+		copy.mipLevels = mipLevels;
+
+		// Regions are relative to the start of the staging region
+		for (auto& region : copy.regions)
+		{
+			region.bufferOffset += source.offset;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pendingImageCopies.push_back(std::move(copy));
+		markRecorded(source._id);
+	}
+
+	SorpUploadQueue::Token SorpUploadQueue::flush()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		retireCompletedBatches(false, 0);
+
+		if (_pendingBufferCopies.empty() && _pendingImageCopies.empty())
+		{
+			// Nothing new, the last submitted batch is what the caller has to wait for
+			return _nextToken - 1;
+		}
+
+		Batch batch = acquireBatch();
+		batch.token = _nextToken++;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+		std::vector<VkImageMemoryBarrier> preBarriers;
+		std::vector<VkImageMemoryBarrier> postBarriers;
+		preBarriers.reserve(_pendingImageCopies.size());
+		postBarriers.reserve(_pendingImageCopies.size());
+
+		for (const auto& copy : _pendingImageCopies)
+		{
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = copy.image;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = copy.mipLevels;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = 1;
+
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			preBarriers.push_back(barrier);
+
+			// Blitted chains end up entirely in TRANSFER_SRC_OPTIMAL
+			barrier.oldLayout = copy.generateMips ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			postBarriers.push_back(barrier);
+		}
+
+		// Buffers may be overwritten while earlier frames still read them, so wait for all prior work
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, static_cast<uint32_t>(preBarriers.size()), preBarriers.data());
+
+		for (const auto& copy : _pendingBufferCopies)
+		{
+			vkCmdCopyBuffer(batch.commandBuffer, copy.srcBuffer, copy.dstBuffer, 1, &copy.region);
+		}
+
+		for (const auto& copy : _pendingImageCopies)
+		{
+			vkCmdCopyBufferToImage(batch.commandBuffer, copy.srcBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(copy.regions.size()), copy.regions.data());
+			if (copy.generateMips)
+			{
+				recordMipBlits(batch.commandBuffer, copy);
+			}
+		}
+
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(postBarriers.size()), postBarriers.data());
+
+		vkEndCommandBuffer(batch.commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+		if (vkQueueSubmit(_renderDevice.graphicsQueue(), 1, &submitInfo, batch.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit upload batch!");
+		}
+
+		for (auto& reservation : _reservations)
+		{
+			if (reservation.recorded && reservation.token == 0)
+			{
+				reservation.token = batch.token;
+			}
+		}
+
+		_pendingBufferCopies.clear();
+		_pendingImageCopies.clear();
+		_inFlightBatches.push_back(batch);
+
+		return batch.token;
+	}
+
+	bool SorpUploadQueue::isComplete(Token token)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		retireCompletedBatches(false, 0);
+		return token <= _completedToken;
+	}
+
+	void SorpUploadQueue::wait(Token token)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		retireCompletedBatches(true, token);
+	}
+
+	void SorpUploadQueue::waitIdle()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		retireCompletedBatches(true, _nextToken - 1);
+	}
+
+	bool SorpUploadQueue::hasPendingWork()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return !_pendingBufferCopies.empty() || !_pendingImageCopies.empty();
+	}
+
+	void SorpUploadQueue::createCommandPool()
+	{
+		QueueFamilyIndices queueFamilyIndices = _renderDevice.findPhysicalQueueFamilies();
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(_renderDevice.device(), &poolInfo, nullptr, &_commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+	}
+
+	void SorpUploadQueue::recordMipBlits(VkCommandBuffer commandBuffer, const PendingImageCopy& copy)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		int32_t width = static_cast<int32_t>(copy.extent.width);
+		int32_t height = static_cast<int32_t>(copy.extent.height);
+		for (uint32_t level = 1; level < copy.mipLevels; level++)
+		{
+			// The previous level is complete once its copy or blit finished
+			barrier.subresourceRange.baseMipLevel = level - 1;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+
+			int32_t nextWidth = std::max(width / 2, 1);
+			int32_t nextHeight = std::max(height / 2, 1);
+
+			VkImageBlit blit{};
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { width, height, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+
+			vkCmdBlitImage(commandBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, copy.image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			width = nextWidth;
+			height = nextHeight;
+		}
+
+		// Last level too, so the whole chain leaves in one layout
+		barrier.subresourceRange.baseMipLevel = copy.mipLevels - 1;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	void SorpUploadQueue::markRecorded(uint64_t reservationId)
+	{
+		for (auto it = _reservations.rbegin(); it != _reservations.rend(); ++it)
+		{
+			if (it->id == reservationId)
+			{
+				it->recorded = true;
+				return;
+			}
+		}
+	}
+
+	void SorpUploadQueue::cancel(uint64_t reservationId)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto it = _reservations.rbegin(); it != _reservations.rend(); ++it)
+		{
+			if (it->id == reservationId)
+			{
+				// Recorded regions are released by the batch that reads them
+				if (!it->recorded)
+				{
+					it->cancelled = true;
+					releaseReservations();
+				}
+				return;
+			}
+		}
+	}
+
+	SorpUploadQueue::Batch SorpUploadQueue::acquireBatch()
+	{
+		Batch batch{};
+		if (!_freeBatches.empty())
+		{
+			batch = _freeBatches.back();
+			_freeBatches.pop_back();
+
+			vkResetFences(_renderDevice.device(), 1, &batch.fence);
+			vkResetCommandBuffer(batch.commandBuffer, 0);
+			return batch;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = _commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(_renderDevice.device(), &allocInfo, &batch.commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if (vkCreateFence(_renderDevice.device(), &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload fence!");
+		}
+
+		return batch;
+	}
+
+	void SorpUploadQueue::retireCompletedBatches(bool wait, Token waitToken)
+	{
+		while (!_inFlightBatches.empty())
+		{
+			Batch& batch = _inFlightBatches.front();
+
+			if (wait && batch.token <= waitToken)
+			{
+				SORP_PROFILE_SCOPE("wait upload fence");
+				vkWaitForFences(_renderDevice.device(), 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			}
+			else if (vkGetFenceStatus(_renderDevice.device(), batch.fence) != VK_SUCCESS)
+			{
+				break;
+			}
+
+			_completedToken = batch.token;
+			_freeBatches.push_back(batch);
+			_inFlightBatches.pop_front();
+		}
+
+		releaseReservations();
+	}
+
+	void SorpUploadQueue::releaseReservations()
+	{
+		// Ring space is handed back strictly in reservation order so the ring never gets holes
+		while (!_reservations.empty())
+		{
+			Reservation& reservation = _reservations.front();
+			if (!reservation.cancelled && (reservation.token == 0 || reservation.token > _completedToken))
+			{
+				break;
+			}
+
+			if (reservation.standaloneBuffer != VK_NULL_HANDLE)
+			{
+				_renderDevice.destroyBuffer(reservation.standaloneBuffer, reservation.standaloneAllocation);
+			}
+
+			_ringUsed -= reservation.bytes;
+			_reservations.pop_front();
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "SorpRenderDevice.hpp"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace sorp_v
+{
+	// Batches buffer and image uploads into a single command buffer per flush. Source data lives in a
+	// persistently mapped staging ring that is recycled once the fence of the batch that read it signals.
+	class SorpUploadQueue
+	{
+	public:
+		using Token = uint64_t;
+
+		// Handing a region to one of the upload calls records it. A region that goes out of scope unrecorded, say
+		// because the caller threw before uploading, gives its space back instead of pinning the ring.
+		// Must not outlive the queue.
+		class StagingRegion
+		{
+		public:
+			StagingRegion() = default;
+			~StagingRegion();
+
+			StagingRegion(StagingRegion&& other) noexcept;
+			StagingRegion& operator=(StagingRegion&& other) noexcept;
+			StagingRegion(const StagingRegion&) = delete;
+			StagingRegion& operator=(const StagingRegion&) = delete;
+
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			void* mapped = nullptr;
+
+		private:
+			friend class SorpUploadQueue;
+
+			SorpUploadQueue* _queue = nullptr;
+			uint64_t _id = 0;
+		};
+
+		static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+
+		SorpUploadQueue(SorpRenderDevice& renderDevice, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+		~SorpUploadQueue();
+
+		SorpUploadQueue(const SorpUploadQueue&) = delete;
+		SorpUploadQueue& operator=(const SorpUploadQueue&) = delete;
+
+		// Staging memory the caller writes into directly. Safe to call from any thread, never blocks:
+		// if the ring is full a standalone staging buffer is handed out instead.
+		StagingRegion reserve(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+		void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+		void uploadBuffer(const StagingRegion& source, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+		// Uploads mip 0 and leaves the image in SHADER_READ_ONLY_OPTIMAL. With more than one mip level the rest of
+		// the chain is blitted down from mip 0, the image needs TRANSFER_SRC usage and a format that supports
+		// linear filtered blits.
+		void uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+			uint32_t mipLevels = 1);
+		void uploadImage(const StagingRegion& source, VkImage image, const std::vector<VkBufferImageCopy>& regions, uint32_t mipLevels);
+
+		// Records everything queued so far into one command buffer and submits it without waiting.
+		// Must be called from the thread that submits to the graphics queue.
+		Token flush();
+		bool isComplete(Token token);
+		void wait(Token token);
+		void waitIdle();
+
+		bool hasPendingWork();
+
+	private:
+		struct Reservation
+		{
+			uint64_t id;
+			VkDeviceSize bytes;
+			Token token = 0;
+			bool recorded = false;
+			// Released without ever being recorded
+			bool cancelled = false;
+			VkBuffer standaloneBuffer = VK_NULL_HANDLE;
+			SorpAllocation standaloneAllocation;
+		};
+
+		struct PendingBufferCopy
+		{
+			VkBuffer srcBuffer;
+			VkBuffer dstBuffer;
+			VkBufferCopy region;
+		};
+
+		struct PendingImageCopy
+		{
+			VkBuffer srcBuffer;
+			VkImage image;
+			std::vector<VkBufferImageCopy> regions;
+			uint32_t mipLevels;
+			// Levels past 0 are blitted instead of copied
+			bool generateMips = false;
+			VkExtent2D extent = {};
+		};
+
+		struct Batch
+		{
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			Token token = 0;
+		};
+
+		SorpRenderDevice& _renderDevice;
+		VkCommandPool _commandPool;
+
+		VkBuffer _ringBuffer;
+		SorpAllocation _ringAllocation;
+		VkDeviceSize _ringSize;
+		VkDeviceSize _ringHead = 0;
+		VkDeviceSize _ringUsed = 0;
+
+		std::mutex _mutex;
+		std::deque<Reservation> _reservations;
+		uint64_t _nextReservationId = 1;
+
+		std::vector<PendingBufferCopy> _pendingBufferCopies;
+		std::vector<PendingImageCopy> _pendingImageCopies;
+
+		std::deque<Batch> _inFlightBatches;
+		std::vector<Batch> _freeBatches;
+		Token _nextToken = 1;
+		Token _completedToken = 0;
+
+		void createCommandPool();
+		void recordMipBlits(VkCommandBuffer commandBuffer, const PendingImageCopy& copy);
+		void markRecorded(uint64_t reservationId);
+		void cancel(uint64_t reservationId);
+		Batch acquireBatch();
+		void retireCompletedBatches(bool wait, Token waitToken);
+		void releaseReservations();
+	};
+}
@@ -16,6 +16,16 @@ namespace sorp_v
 		glfwTerminate();
 	}
 
+	bool SorpWindow::wasKeyPressed(int key)
+	{
+		if (key < 0 || key > GLFW_KEY_LAST || !pressedKeys[key])
+		{
+			return false;
+		}
+		pressedKeys[key] = false;
+		return true;
+	}
+
 	void SorpWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface)
 	{
 		if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS) {
@@ -32,6 +42,7 @@ namespace sorp_v
 		window = glfwCreateWindow(width, height, windowName.c_str(), nullptr, nullptr);
 		glfwSetWindowUserPointer(window, this);
 		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetKeyCallback(window, keyCallback);
 	}
 
 	void SorpWindow::framebufferResizeCallback(GLFWwindow* window, int width, int height)
@@ -41,4 +52,14 @@ namespace sorp_v
 		sorpWindow->width = width;
 		sorpWindow->height = height;
 	}
+
+	void SorpWindow::keyCallback(GLFWwindow* window, int key, int, int action, int)
+	{
+		auto sorpWindow = reinterpret_cast<SorpWindow *>(glfwGetWindowUserPointer(window));
+		// GLFW_KEY_UNKNOWN is -1
+		if (action == GLFW_PRESS && key >= 0 && key <= GLFW_KEY_LAST)
+		{
+			sorpWindow->pressedKeys[key] = true;
+		}
+	}
 }
\ No newline at end of file
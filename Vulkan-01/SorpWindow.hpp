@@ -2,6 +2,7 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <array>
 #include <string>
 
 namespace sorp_v 
@@ -20,6 +21,10 @@ namespace sorp_v
 
 		bool wasWindowResized() { return frameBufferResized; }
 		void resetWindowResizedFlag() { frameBufferResized = false; }
+		// True once per press since the last call
+		bool wasKeyPressed(int key);
+
+		void setTitle(const std::string& title) { glfwSetWindowTitle(window, title.c_str()); }
 
 		void createWindowSurface(VkInstance instance, VkSurfaceKHR* surface);
 
@@ -30,8 +35,11 @@ namespace sorp_v
 		int width;
 		int height;
 		bool frameBufferResized = false;
+		// Fixed size so holding or mashing keys nobody polls never grows anything
+		std::array<bool, GLFW_KEY_LAST + 1> pressedKeys = {};
 
 		static void framebufferResizeCallback(GLFWwindow *window, int width, int height);
+		static void keyCallback(GLFWwindow* window, int key, int, int action, int);
 
 		void init();
 	};
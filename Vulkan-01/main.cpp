@@ -9,17 +9,106 @@
 #include <iostream>
 
 #include "SorpSimpleApp.hpp"
+#include "SorpBenchmark.hpp"
+#include "SorpTextureCooker.hpp"
 
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 
-int main() 
+int main(int argc, char** argv) 
 {
-    sorp_v::SorpSimpleApp app{};
+    sorp_v::SorpAppSettings settings{};
+    bool benchmark = false;
+    std::string benchmarkPath;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench-jobs") == 0)
+        {
+            sorp_v::SorpBenchmark::runJobSystem(std::cout);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "--cook-textures") == 0)
+        {
+            try
+            {
+                std::string directory = i + 1 < argc ? argv[i + 1] : sorp_v::SorpPathResolver{}.resolve(std::string{ "textures" });
+                sorp_v::SorpJobSystem jobSystem{};
+                uint32_t cooked = sorp_v::SorpTextureCooker::cookDirectory(jobSystem, directory, std::cout);
+                std::cout << "cooked " << cooked << " textures\n";
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            settings.framesInFlight = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        if (strcmp(argv[i], "--min-draws-per-thread") == 0 && i + 1 < argc)
+        {
+            settings.minDrawsPerThread = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            settings.tracePath = argv[++i];
+        }
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            settings.headless = true;
+        }
+        if (strcmp(argv[i], "--headless-surface") == 0)
+        {
+            settings.headless = true;
+            settings.headlessSurface = true;
+        }
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            settings.frameLimit = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        if (strcmp(argv[i], "--pipeline-stats") == 0)
+        {
+            settings.pipelineStatistics = true;
+        }
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            benchmark = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+            {
+                benchmarkPath = argv[++i];
+            }
+        }
+    }
 
     try 
     {
+        if (benchmark)
+        {
+            // No vsync or window events in the numbers unless a surface was asked for
+            settings.headless = true;
+            uint32_t frames = settings.frameLimit != 0 ? settings.frameLimit : sorp_v::SorpBenchmark::DEFAULT_MEASURED_FRAMES;
+            if (benchmarkPath.empty())
+            {
+                sorp_v::SorpBenchmark::runRendering(settings, frames, std::cout);
+            }
+            else
+            {
+                std::ofstream file{ benchmarkPath };
+                if (!file)
+                {
+                    throw std::runtime_error("failed to open benchmark report file!");
+                }
+                sorp_v::SorpBenchmark::runRendering(settings, frames, file);
+            }
+            return EXIT_SUCCESS;
+        }
+
+        sorp_v::SorpSimpleApp app{ settings };
         app.run();
     }
     catch (std::exception &e)